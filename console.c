@@ -8,18 +8,40 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
 #include <sys/select.h>
 #include <sys/stat.h>
 #include <sys/types.h>
+#include <time.h>
 #include <unistd.h>
 
 #include "console.h"
 #include "report.h"
 
+/*
+ * Open addressing table of named elements, so that commands and parameters
+ * are found in O(1).  The lists stay in alphabetical order for help.
+ */
+typedef struct {
+    char *name;
+    void *ele;
+} name_slot;
+
+typedef struct {
+    name_slot *slots;
+    size_t cap; /* Power of 2, or 0 before the first insertion */
+    size_t cnt;
+} name_table;
+
+/* Tables are kept at most half full */
+#define NAME_TABLE_MIN_CAP 64
+
 /* Some global values */
 bool simulation = false;
 static cmd_ptr cmd_list = NULL;
 static param_ptr param_list = NULL;
+static name_table cmd_table;
+static name_table param_table;
 static bool block_flag = false;
 static bool prompt_flag = true;
 
@@ -33,6 +55,7 @@ static double last_time;
 /*
  * Implement buffered I/O using variant of RIO package from CS:APP
  * Must create stack of buffers to handle I/O with nested source commands.
+ * Regular files are mapped instead, and their lines handed out in place.
  */
 
 #define RIO_BUFSIZE 8192
@@ -43,12 +66,35 @@ struct RIO_ELE {
     int cnt;               /* Unread bytes in internal buffer */
     char *bufptr;          /* Next unread byte in internal buffer */
     char buf[RIO_BUFSIZE]; /* Internal buffer */
+    char *map;             /* Private mapping of the file, or NULL */
+    size_t map_len;        /* Bytes mapped */
+    size_t map_pos;        /* Offset of next unread byte in mapping */
+    bool compiled;         /* Mapping holds a compiled trace */
+    char **strs;           /* Its string table */
+    cmd_ptr *ops;          /* Command named by each string, or NULL */
+    size_t nstrs;          /* Strings in the table */
+    size_t nrecords;       /* Records still to execute */
     rio_ptr prev;          /* Next element in stack */
 };
 
 static rio_ptr buf_stack;
 static char linebuf[RIO_BUFSIZE];
 
+/* Words in a line of linebuf, each followed by at least one space */
+#define MAXARGS (RIO_BUFSIZE / 2)
+
+/*
+ * Compiled traces, written by compile_trace, start with this magic number.
+ * It is followed by the size of the string table and the number of
+ * records, then the string table: each string as its length, its
+ * characters and a null character, so that the words can be used where
+ * they are mapped.  Then comes one record per line: the number of words,
+ * then the index of each word in the string table, the first one naming
+ * the command.  All numbers are LEB128 varints.
+ */
+#define TRACE_MAGIC "QTB1"
+#define TRACE_MAGIC_LEN (sizeof(TRACE_MAGIC) - 1)
+
 /* Maximum file descriptor */
 static int fd_max = 0;
 
@@ -74,6 +120,7 @@ static bool do_source_cmd(int argc, char *argv[]);
 static bool do_log_cmd(int argc, char *argv[]);
 static bool do_time_cmd(int argc, char *argv[]);
 static bool do_comment_cmd(int argc, char *argv[]);
+static bool do_replay_cmd(int argc, char *argv[]);
 
 static void init_in();
 
@@ -81,12 +128,15 @@ static bool push_file(char *fname);
 static void pop_file();
 
 static bool interpret_cmda(int argc, char *argv[]);
+static void table_clear(name_table *t);
 
 /* Initialize interpreter */
 void init_cmd()
 {
     cmd_list = NULL;
     param_list = NULL;
+    table_clear(&cmd_table);
+    table_clear(&param_table);
     err_cnt = 0;
     quit_flag = false;
 
@@ -99,6 +149,8 @@ void init_cmd()
     add_cmd("log", do_log_cmd, " file           | Copy output to file");
     add_cmd("time", do_time_cmd, " cmd arg ...    | Time command execution");
     add_cmd("#", do_comment_cmd, " ...            | Display comment");
+    add_cmd("replay", do_replay_cmd,
+            " file [fast]    | Replay timed log of commands, show latencies");
     add_param("simulation", (int *) &simulation, "Start/Stop simulation mode",
               NULL);
     add_param("verbose", &verblevel, "Verbosity level", NULL);
@@ -110,6 +162,65 @@ void init_cmd()
     first_time = last_time;
 }
 
+/* FNV-1a hash of a name */
+static size_t name_hash(const char *name)
+{
+    uint64_t h = 0xcbf29ce484222325;
+    while (*name) {
+        h ^= (unsigned char) *name++;
+        h *= 0x100000001b3;
+    }
+    return h;
+}
+
+/* Slot holding name, or the empty slot where it would go */
+static name_slot *table_slot(name_table *t, const char *name)
+{
+    size_t mask = t->cap - 1;
+    size_t i = name_hash(name) & mask;
+    while (t->slots[i].name && strcmp(t->slots[i].name, name) != 0)
+        i = (i + 1) & mask;
+    return &t->slots[i];
+}
+
+/* Element added under name, NULL if there is none */
+static void *table_find(name_table *t, const char *name)
+{
+    if (!t->cap)
+        return NULL;
+    return table_slot(t, name)->ele;
+}
+
+/* Add ele under name, replacing what was there */
+static void table_insert(name_table *t, char *name, void *ele)
+{
+    if (2 * (t->cnt + 1) > t->cap) {
+        name_slot *old = t->slots;
+        size_t old_cap = t->cap;
+        t->cap = old_cap ? 2 * old_cap : NAME_TABLE_MIN_CAP;
+        t->slots = calloc_or_fail(t->cap, sizeof(name_slot), "table_insert");
+        for (size_t i = 0; i < old_cap; i++) {
+            if (old[i].name)
+                *table_slot(t, old[i].name) = old[i];
+        }
+        if (old)
+            free_array(old, old_cap, sizeof(name_slot));
+    }
+    name_slot *slot = table_slot(t, name);
+    if (!slot->name)
+        t->cnt++;
+    slot->name = name;
+    slot->ele = ele;
+}
+
+static void table_clear(name_table *t)
+{
+    if (t->slots)
+        free_array(t->slots, t->cap, sizeof(name_slot));
+    t->slots = NULL;
+    t->cap = t->cnt = 0;
+}
+
 /* Add a new command */
 void add_cmd(char *name, cmd_function operation, char *documentation)
 {
@@ -126,6 +237,7 @@ void add_cmd(char *name, cmd_function operation, char *documentation)
     ele->documentation = documentation;
     ele->next = next_cmd;
     *last_loc = ele;
+    table_insert(&cmd_table, name, ele);
 }
 
 /* Add a new parameter */
@@ -148,50 +260,41 @@ void add_param(char *name,
     ele->setter = setter;
     ele->next = next_param;
     *last_loc = ele;
+    table_insert(&param_table, name, ele);
 }
 
-/* Parse a string into a command line */
+/*
+ * Parse a string into a command line, in place: the white space ending each
+ * word is overwritten with a null character, and the words are pointed to
+ * from an array reused by every call, so that no command costs an
+ * allocation.  The array holds as many words as a line read by readline;
+ * longer lines, which getline and linenoise can return, are rejected with
+ * a null result rather than cut short.
+ */
 static char **parse_args(char *line, int *argcp)
 {
-    /*
-     * Must first determine how many arguments there are.
-     * Replace all white space with null characters
-     */
-    size_t len = strlen(line);
-    /* First copy into buffer with each substring null-terminated */
-    char *buf = malloc_or_fail(len + 1, "parse_args");
+    static char *argv[MAXARGS + 1];
+    int argc = 0;
     char *src = line;
-    char *dst = buf;
-    bool skipping = true;
 
-    int c;
-    int argc = 0;
-    while ((c = *src++) != '\0') {
-        if (isspace(c)) {
-            if (!skipping) {
-                /* Hit end of word */
-                *dst++ = '\0';
-                skipping = true;
-            }
-        } else {
-            if (skipping) {
-                /* Hit start of new word */
-                argc++;
-                skipping = false;
-            }
-            *dst++ = c;
+    while (true) {
+        while (isspace((unsigned char) *src))
+            src++;
+        if (*src == '\0')
+            break;
+        if (argc == MAXARGS) {
+            report(1, "ERROR: Line holds more than %d words", MAXARGS);
+            return NULL;
         }
+        /* Hit start of new word */
+        argv[argc++] = src;
+        while (*src != '\0' && !isspace((unsigned char) *src))
+            src++;
+        if (*src != '\0')
+            *src++ = '\0';
     }
+    argv[argc] = NULL;
 
-    /* Now assemble into array of strings */
-    char **argv = calloc_or_fail(argc, sizeof(char *), "parse_args");
-    src = buf;
-    for (int i = 0; i < argc; i++) {
-        argv[i] = strsave_or_fail(src, "parse_args");
-        src += strlen(argv[i]) + 1;
-    }
-
-    free_block(buf, len + 1);
     *argcp = argc;
     return argv;
 }
@@ -205,19 +308,12 @@ static void record_error()
     }
 }
 
-/* Execute a command that has already been split into arguments */
-static bool interpret_cmda(int argc, char *argv[])
+/* Execute command cmd, found for argv[0] if there is one */
+static bool run_cmd(cmd_ptr cmd, int argc, char *argv[])
 {
-    if (argc == 0)
-        return true;
-
-    /* Try to find matching command */
-    cmd_ptr next_cmd = cmd_list;
     bool ok = true;
-    while (next_cmd && strcmp(argv[0], next_cmd->name) != 0)
-        next_cmd = next_cmd->next;
-    if (next_cmd) {
-        ok = next_cmd->operation(argc, argv);
+    if (cmd) {
+        ok = cmd->operation(argc, argv);
         if (!ok)
             record_error();
     } else {
@@ -229,6 +325,16 @@ static bool interpret_cmda(int argc, char *argv[])
     return ok;
 }
 
+/* Execute a command that has already been split into arguments */
+static bool interpret_cmda(int argc, char *argv[])
+{
+    if (argc == 0)
+        return true;
+
+    /* Try to find matching command */
+    return run_cmd(table_find(&cmd_table, argv[0]), argc, argv);
+}
+
 /* Execute a command from a command line */
 static bool interpret_cmd(char *cmdline)
 {
@@ -240,12 +346,11 @@ static bool interpret_cmd(char *cmdline)
 #endif
     int argc;
     char **argv = parse_args(cmdline, &argc);
-    bool ok = interpret_cmda(argc, argv);
-    for (int i = 0; i < argc; i++)
-        free_string(argv[i]);
-    free_array(argv, argc, sizeof(char *));
-
-    return ok;
+    if (!argv) {
+        record_error();
+        return false;
+    }
+    return interpret_cmda(argc, argv);
 }
 
 /* Set function to be executed as part of program exit */
@@ -280,14 +385,17 @@ static bool do_quit_cmd(int argc, char *argv[])
         p = p->next;
         free_block(ele, sizeof(param_ele));
     }
-
-    while (buf_stack)
-        pop_file();
+    table_clear(&cmd_table);
+    table_clear(&param_table);
 
     for (int i = 0; i < quit_helper_cnt; i++) {
         ok = ok && quit_helpers[i](argc, argv);
     }
 
+    /* After the helpers, as argv may point into a mapped file */
+    while (buf_stack)
+        pop_file();
+
     quit_flag = true;
     return ok;
 }
@@ -362,16 +470,13 @@ static bool do_option_cmd(int argc, char *argv[])
             return false;
         }
         /* Find parameter in list */
-        param_ptr plist = param_list;
-        while (!found && plist) {
-            if (strcmp(plist->name, name) == 0) {
-                int oldval = *plist->valp;
-                *plist->valp = value;
-                if (plist->setter)
-                    plist->setter(oldval);
-                found = true;
-            } else
-                plist = plist->next;
+        param_ptr plist = table_find(&param_table, name);
+        if (plist) {
+            int oldval = *plist->valp;
+            *plist->valp = value;
+            if (plist->setter && !plist->setter(oldval))
+                return false;
+            found = true;
         }
         /* Didn't find parameter */
         if (!found) {
@@ -432,6 +537,281 @@ static bool do_time_cmd(int argc, char *argv[])
     return ok;
 }
 
+/*
+ * Latencies of the commands of a replayed log, in histograms of powers of
+ * two: bucket i counts latencies below 2^i ns, and not below 2^(i-1) ns.
+ */
+#define LATENCY_BUCKETS 40
+
+typedef struct OP_STATS op_stats, *op_stats_ptr;
+struct OP_STATS {
+    char *name;
+    size_t cnt;
+    size_t errors;
+    double total_ns;
+    double max_ns;
+    size_t max_line; /* Line of the log taking max_ns */
+    size_t hist[LATENCY_BUCKETS];
+    op_stats_ptr next; /* In order of first appearance */
+};
+
+static uint64_t now_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/* Format a duration in ns with a readable unit */
+static char *format_ns(char *buf, size_t len, double ns)
+{
+    if (ns < 1e3)
+        snprintf(buf, len, "%.0fns", ns);
+    else if (ns < 1e6)
+        snprintf(buf, len, "%.1fus", ns / 1e3);
+    else if (ns < 1e9)
+        snprintf(buf, len, "%.1fms", ns / 1e6);
+    else
+        snprintf(buf, len, "%.2fs", ns / 1e9);
+    return buf;
+}
+
+/* Bound on the latencies of the fraction p of the commands of st */
+static double percentile_ns(op_stats_ptr st, double p)
+{
+    size_t seen = 0;
+    int i;
+    for (i = 0; i < LATENCY_BUCKETS - 1; i++) {
+        seen += st->hist[i];
+        if (seen >= p * st->cnt)
+            break;
+    }
+    double bound = (double) ((uint64_t) 1 << i);
+    return bound < st->max_ns ? bound : st->max_ns;
+}
+
+static void report_latencies(op_stats_ptr st)
+{
+    char mean[16], p50[16], p99[16], max[16];
+    report(1, "%-10s %10s %8s %9s %9s %9s %9s %8s", "command", "count",
+           "errors", "mean", "p50<", "p99<", "max", "at line");
+    for (op_stats_ptr s = st; s; s = s->next) {
+        report(1, "%-10s %10lu %8lu %9s %9s %9s %9s %8lu", s->name, s->cnt,
+               s->errors, format_ns(mean, 16, s->total_ns / s->cnt),
+               format_ns(p50, 16, percentile_ns(s, 0.5)),
+               format_ns(p99, 16, percentile_ns(s, 0.99)),
+               format_ns(max, 16, s->max_ns), s->max_line);
+    }
+
+    for (op_stats_ptr s = st; s; s = s->next) {
+        int lo = 0, hi = LATENCY_BUCKETS - 1;
+        size_t most = 0;
+        while (!s->hist[lo])
+            lo++;
+        while (!s->hist[hi])
+            hi--;
+        for (int i = lo; i <= hi; i++) {
+            if (s->hist[i] > most)
+                most = s->hist[i];
+        }
+        report(1, "%s latencies:", s->name);
+        for (int i = lo; i <= hi; i++) {
+            char bound[16], bar[41];
+            size_t width = (s->hist[i] * 40 + most - 1) / most;
+            memset(bar, '#', width);
+            bar[width] = '\0';
+            report(1, "  < %8s %10lu %s",
+                   format_ns(bound, 16, (double) ((uint64_t) 1 << i)),
+                   s->hist[i], bar);
+        }
+    }
+}
+
+/*
+ * Replay a log of commands, one per line, each preceded by the time it was
+ * issued, in microseconds.  The log is read a line at a time, so that it
+ * can be longer than memory.  Commands are issued at the pace they were
+ * logged, or as fast as possible with option fast, and the latency of each
+ * one is added to the histogram of its command.  Blank lines and lines
+ * starting with '#' are skipped.
+ */
+static bool do_replay_cmd(int argc, char *argv[])
+{
+    if (argc != 2 && (argc != 3 || strcmp(argv[2], "fast") != 0)) {
+        report(1, "%s takes a file, optionally followed by 'fast'", argv[0]);
+        return false;
+    }
+    /* Lines are split in the array argv belongs to */
+    char *fname = argv[1];
+    bool paced = argc == 2;
+    FILE *log = fopen(fname, "r");
+    if (!log) {
+        report(1, "Could not open replay log '%s'", fname);
+        return false;
+    }
+
+    /* Commands print nothing but errors, which would skew their latency */
+    int old_verblevel = verblevel;
+    if (verblevel > 1)
+        set_verblevel(1);
+
+    name_table stats_table = {NULL, 0, 0};
+    op_stats_ptr stats = NULL, *last_loc = &stats;
+    char *line = NULL;
+    size_t line_cap = 0, lineno = 0, replayed = 0, failed = 0;
+    uint64_t first_us = 0, start_ns = now_ns();
+    double max_delay_ns = 0;
+    bool ok = true;
+    while (!quit_flag && getline(&line, &line_cap, log) >= 0) {
+        lineno++;
+        int largc;
+        char **largv = parse_args(line, &largc);
+        if (!largv) {
+            report(1, "ERROR: Could not parse line %lu of '%s'", lineno,
+                   fname);
+            ok = false;
+            break;
+        }
+        if (largc == 0 || largv[0][0] == '#')
+            continue;
+        char *end;
+        uint64_t us = strtoull(largv[0], &end, 10);
+        if (*end != '\0' || largc < 2) {
+            report(1, "ERROR: Line %lu of '%s' is not a time and a command",
+                   lineno, fname);
+            ok = false;
+            break;
+        }
+
+        if (replayed == 0) {
+            first_us = us;
+            start_ns = now_ns();
+        }
+        if (paced && us > first_us) {
+            uint64_t due = start_ns + (us - first_us) * 1000;
+            uint64_t now = now_ns();
+            if (now < due) {
+                struct timespec ts = {due / 1000000000, due % 1000000000};
+                clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL);
+            } else if (now - due > max_delay_ns) {
+                max_delay_ns = now - due;
+            }
+        }
+
+        op_stats_ptr st = table_find(&stats_table, largv[1]);
+        if (!st) {
+            st = calloc_or_fail(1, sizeof(op_stats), "do_replay_cmd");
+            st->name = strsave_or_fail(largv[1], "do_replay_cmd");
+            table_insert(&stats_table, st->name, st);
+            *last_loc = st;
+            last_loc = &st->next;
+        }
+
+        cmd_ptr cmd = table_find(&cmd_table, largv[1]);
+        uint64_t before = now_ns();
+        bool cmd_ok = cmd ? cmd->operation(largc - 1, largv + 1) : false;
+        double ns = now_ns() - before;
+        if (!cmd)
+            report(1, "Unknown command '%s'", largv[1]);
+
+        st->cnt++;
+        st->total_ns += ns;
+        if (ns > st->max_ns) {
+            st->max_ns = ns;
+            st->max_line = lineno;
+        }
+        int bucket = 0;
+        while (bucket < LATENCY_BUCKETS - 1 &&
+               (double) ((uint64_t) 1 << bucket) <= ns)
+            bucket++;
+        st->hist[bucket]++;
+        if (!cmd_ok) {
+            st->errors++;
+            failed++;
+        }
+        replayed++;
+    }
+    free(line);
+    fclose(log);
+    set_verblevel(old_verblevel);
+
+    double elapsed = (now_ns() - start_ns) / 1e9;
+    report(1, "Replayed %lu commands in %.3f s", replayed, elapsed);
+    if (paced) {
+        char delay[16];
+        report(1, "Latest start behind the log: %s",
+               format_ns(delay, 16, max_delay_ns));
+    }
+    if (stats)
+        report_latencies(stats);
+    if (failed > 0) {
+        report(1, "ERROR: %lu commands failed", failed);
+        ok = false;
+    }
+
+    while (stats) {
+        op_stats_ptr st = stats;
+        stats = st->next;
+        free_string(st->name);
+        free_block(st, sizeof(op_stats));
+    }
+    table_clear(&stats_table);
+    return ok;
+}
+
+/*
+ * Decode the varint at the read position of mapping r into *valp.
+ * Return false if the mapping ends before it does.
+ */
+static bool read_varint(rio_ptr r, size_t *valp)
+{
+    size_t val = 0;
+    for (unsigned shift = 0; r->map_pos < r->map_len && shift < 64;
+         shift += 7) {
+        unsigned char byte = r->map[r->map_pos++];
+        val |= (size_t) (byte & 0x7f) << shift;
+        if (!(byte & 0x80)) {
+            *valp = val;
+            return true;
+        }
+    }
+    return false;
+}
+
+/*
+ * Read the string table of the compiled trace mapped by r, and find the
+ * command each string names, so that records are executed without looking
+ * anything up.  Leave r positioned on the first record.
+ * Return false if the table is corrupt.
+ */
+static bool load_trace(rio_ptr r)
+{
+    size_t nstrs;
+    r->map_pos = TRACE_MAGIC_LEN;
+    /* Each string takes at least two bytes, and each record one */
+    if (!read_varint(r, &nstrs) || nstrs > r->map_len / 2 ||
+        !read_varint(r, &r->nrecords) || r->nrecords > r->map_len)
+        return false;
+    if (nstrs == 0)
+        return true;
+
+    r->strs = calloc_or_fail(nstrs, sizeof(char *), "load_trace");
+    r->ops = calloc_or_fail(nstrs, sizeof(cmd_ptr), "load_trace");
+    r->nstrs = nstrs;
+    for (size_t i = 0; i < nstrs; i++) {
+        size_t len;
+        if (!read_varint(r, &len) || len >= r->map_len - r->map_pos)
+            return false;
+        char *str = r->map + r->map_pos;
+        if (str[len] != '\0')
+            return false;
+        r->strs[i] = str;
+        r->ops[i] = table_find(&cmd_table, str);
+        r->map_pos += len + 1;
+    }
+    return true;
+}
+
 /* Create new buffer for named file.
  * Name == NULL for stdin.
  * Return true if successful.
@@ -449,9 +829,39 @@ static bool push_file(char *fname)
     rnew->fd = fd;
     rnew->cnt = 0;
     rnew->bufptr = rnew->buf;
+    rnew->map = NULL;
+    rnew->map_len = rnew->map_pos = 0;
+    rnew->compiled = false;
+    rnew->strs = NULL;
+    rnew->ops = NULL;
+    rnew->nstrs = 0;
+    rnew->nrecords = 0;
     rnew->prev = buf_stack;
+
+    /*
+     * Map regular files.  The mapping is private and writable, so that lines
+     * can be terminated and split into words where they are.
+     */
+    struct stat st;
+    if (fname && fstat(fd, &st) == 0 && S_ISREG(st.st_mode) &&
+        st.st_size > 0) {
+        void *map = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE,
+                         MAP_PRIVATE, fd, 0);
+        if (map != MAP_FAILED) {
+            rnew->map = map;
+            rnew->map_len = st.st_size;
+        }
+    }
     buf_stack = rnew;
 
+    rnew->compiled = rnew->map && rnew->map_len >= TRACE_MAGIC_LEN &&
+                     memcmp(rnew->map, TRACE_MAGIC, TRACE_MAGIC_LEN) == 0;
+    if (rnew->compiled && !load_trace(rnew)) {
+        report(1, "ERROR: Corrupt compiled trace '%s'", fname);
+        pop_file();
+        return false;
+    }
+
     return true;
 }
 
@@ -463,6 +873,12 @@ static void pop_file()
     if (buf_stack) {
         rio_ptr rsave = buf_stack;
         buf_stack = rsave->prev;
+        if (rsave->map)
+            munmap(rsave->map, rsave->map_len);
+        if (rsave->strs) {
+            free_array(rsave->strs, rsave->nstrs, sizeof(char *));
+            free_array(rsave->ops, rsave->nstrs, sizeof(cmd_ptr));
+        }
         close(rsave->fd);
         free_block(rsave, sizeof(rio_t));
     }
@@ -474,19 +890,63 @@ static void init_in()
     buf_stack = NULL;
 }
 
-/* Read command from input file.
+static void echo_line(char *line)
+{
+    if (echo) {
+        report_noreturn(1, prompt);
+        report_noreturn(1, "%s\n", line);
+    }
+}
+
+/*
+ * Hand out the next line of a mapped file, where it is, with its newline
+ * replaced by a null character.  An unterminated last line, or a line too
+ * long for linebuf, is copied there instead, the latter split as in the
+ * buffered path.
+ */
+static char *readline_mapped(rio_ptr r)
+{
+    char *line = r->map + r->map_pos;
+    size_t left = r->map_len - r->map_pos;
+    char *nl = memchr(line, '\n', left);
+    size_t len = nl ? (size_t) (nl - line) : left;
+
+    if (nl && len <= RIO_BUFSIZE - 2) {
+        *nl = '\0';
+        r->map_pos += len + 1;
+    } else {
+        if (len > RIO_BUFSIZE - 2)
+            len = RIO_BUFSIZE - 2;
+        memcpy(linebuf, line, len);
+        linebuf[len] = '\0';
+        r->map_pos += len;
+        line = linebuf;
+    }
+    return line;
+}
+
+/*
+ * Read command from input file, without its newline.
  * When hit EOF, close that file and return NULL
  */
 static char *readline()
 {
-    int cnt;
-    char c;
-    char *lptr = linebuf;
+    size_t cnt = 0;
 
     if (!buf_stack)
         return NULL;
 
-    for (cnt = 0; cnt < RIO_BUFSIZE - 2; cnt++) {
+    if (buf_stack->map) {
+        if (buf_stack->map_pos >= buf_stack->map_len) {
+            pop_file();
+            return NULL;
+        }
+        char *line = readline_mapped(buf_stack);
+        echo_line(line);
+        return line;
+    }
+
+    while (cnt < RIO_BUFSIZE - 2) {
         if (buf_stack->cnt <= 0) {
             /* Need to read from input file */
             buf_stack->cnt = read(buf_stack->fd, buf_stack->buf, RIO_BUFSIZE);
@@ -497,49 +957,102 @@ static char *readline()
                 if (cnt > 0) {
                     /* Last line of file did not terminate with newline. */
                     /*  Terminate line & return it */
-                    *lptr++ = '\n';
-                    *lptr++ = '\0';
-                    if (echo) {
-                        report_noreturn(1, prompt);
-                        report_noreturn(1, linebuf);
-                    }
+                    linebuf[cnt] = '\0';
+                    echo_line(linebuf);
                     return linebuf;
                 }
                 return NULL;
             }
         }
 
-        /* Have text in buffer */
-        c = *buf_stack->bufptr++;
-        *lptr++ = c;
-        buf_stack->cnt--;
-        if (c == '\n')
+        /* Have text in buffer, copy it up to the newline */
+        size_t n = RIO_BUFSIZE - 2 - cnt;
+        if (n > (size_t) buf_stack->cnt)
+            n = buf_stack->cnt;
+        char *nl = memchr(buf_stack->bufptr, '\n', n);
+        if (nl)
+            n = nl - buf_stack->bufptr + 1;
+        memcpy(linebuf + cnt, buf_stack->bufptr, n);
+        buf_stack->bufptr += n;
+        buf_stack->cnt -= n;
+        cnt += n;
+        if (nl) {
+            cnt--;
             break;
+        }
+    }
+
+    /* Hit buffer limit, or newline, which is dropped */
+    linebuf[cnt] = '\0';
+    echo_line(linebuf);
+    return linebuf;
+}
+
+/*
+ * Execute the next record of compiled trace r.  When hit its end, or a
+ * corrupt record, close that file.  A trace ending before its last record,
+ * or going on after it, is corrupt.
+ */
+static void interpret_record(rio_ptr r)
+{
+    static char *argv[MAXARGS + 1];
+    size_t argc, op = 0;
+
+    if (r->map_pos >= r->map_len && !r->nrecords) {
+        pop_file();
+        return;
     }
 
-    if (c != '\n') {
-        /* Hit buffer limit.  Artificially terminate line */
-        *lptr++ = '\n';
+    bool ok = r->nrecords > 0 && read_varint(r, &argc) && argc <= MAXARGS;
+    if (ok)
+        r->nrecords--;
+    for (size_t i = 0; ok && i < argc; i++) {
+        size_t idx;
+        ok = read_varint(r, &idx) && idx < r->nstrs;
+        if (ok)
+            argv[i] = r->strs[idx];
+        if (i == 0)
+            op = idx;
     }
-    *lptr++ = '\0';
+    if (!ok) {
+        report(1, "ERROR: Corrupt compiled trace");
+        record_error();
+        pop_file();
+        return;
+    }
+    argv[argc] = NULL;
 
     if (echo) {
         report_noreturn(1, prompt);
-        report_noreturn(1, linebuf);
+        for (size_t i = 0; i < argc; i++)
+            report_noreturn(1, i ? " %s" : "%s", argv[i]);
+        report_noreturn(1, "\n");
     }
+    if (!quit_flag && argc > 0)
+        run_cmd(r->ops[op], argc, argv);
+}
 
-    return linebuf;
+/* Execute the next command from the input, if there is one */
+static void interpret_next()
+{
+    if (buf_stack && buf_stack->compiled) {
+        interpret_record(buf_stack);
+        return;
+    }
+    char *cmdline = readline();
+    if (cmdline)
+        interpret_cmd(cmdline);
 }
 
 /* Determine if there is a complete command line in input buffer */
 static bool read_ready()
 {
-    for (int i = 0; buf_stack && i < buf_stack->cnt; i++) {
-        if (buf_stack->bufptr[i] == '\n')
-            return true;
-    }
-
-    return false;
+    if (!buf_stack)
+        return false;
+    if (buf_stack->map)
+        return buf_stack->map_pos < buf_stack->map_len;
+    return buf_stack->cnt > 0 &&
+           memchr(buf_stack->bufptr, '\n', buf_stack->cnt) != NULL;
 }
 
 static bool cmd_done()
@@ -563,12 +1076,10 @@ int cmd_select(int nfds,
                fd_set *exceptfds,
                struct timeval *timeout)
 {
-    char *cmdline;
     int infd;
     fd_set local_readset;
     while (!block_flag && read_ready()) {
-        cmdline = readline();
-        interpret_cmd(cmdline);
+        interpret_next();
         prompt_flag = true;
     }
 
@@ -604,9 +1115,7 @@ int cmd_select(int nfds,
         /* Commandline input available */
         FD_CLR(infd, readfds);
         result--;
-        cmdline = readline();
-        if (cmdline)
-            interpret_cmd(cmdline);
+        interpret_next();
     }
     return result;
 }
@@ -630,3 +1139,116 @@ bool run_console(char *infile_name)
         cmd_select(0, NULL, NULL, NULL, NULL);
     return err_cnt == 0;
 }
+
+/* Growable array of bytes, for compile_trace */
+typedef struct {
+    unsigned char *data;
+    size_t len, cap;
+} byte_buf;
+
+static void buf_put(byte_buf *b, const void *p, size_t n)
+{
+    if (b->len + n > b->cap) {
+        size_t cap = b->cap ? b->cap : RIO_BUFSIZE;
+        while (cap < b->len + n)
+            cap *= 2;
+        unsigned char *data = malloc_or_fail(cap, "compile_trace");
+        if (b->len)
+            memcpy(data, b->data, b->len);
+        if (b->data)
+            free_block(b->data, b->cap);
+        b->data = data;
+        b->cap = cap;
+    }
+    memcpy(b->data + b->len, p, n);
+    b->len += n;
+}
+
+static void buf_put_varint(byte_buf *b, size_t val)
+{
+    unsigned char bytes[10];
+    size_t n = 0;
+    do {
+        bytes[n] = val & 0x7f;
+        val >>= 7;
+        if (val)
+            bytes[n] |= 0x80;
+        n++;
+    } while (val);
+    buf_put(b, bytes, n);
+}
+
+bool compile_trace(char *in_name, char *out_name)
+{
+    FILE *in = fopen(in_name, "r");
+    if (!in) {
+        report(1, "ERROR: Could not open source file '%s'", in_name);
+        return false;
+    }
+
+    /* Words seen so far, each mapped to its index plus one */
+    name_table words = {NULL, 0, 0};
+    byte_buf strs = {NULL, 0, 0}, records = {NULL, 0, 0};
+    size_t nrecords = 0;
+    char *line = NULL;
+    size_t line_cap = 0, lineno = 0;
+    bool ok = true;
+    while (getline(&line, &line_cap, in) >= 0) {
+        lineno++;
+        int argc;
+        char **argv = parse_args(line, &argc);
+        if (!argv) {
+            report(1, "ERROR: Could not parse line %lu of '%s'", lineno,
+                   in_name);
+            ok = false;
+            break;
+        }
+        buf_put_varint(&records, argc);
+        nrecords++;
+        for (int i = 0; i < argc; i++) {
+            size_t idx = (size_t) table_find(&words, argv[i]);
+            if (!idx) {
+                size_t len = strlen(argv[i]);
+                buf_put_varint(&strs, len);
+                buf_put(&strs, argv[i], len + 1);
+                idx = words.cnt + 1;
+                table_insert(&words, strsave_or_fail(argv[i], "compile_trace"),
+                             (void *) idx);
+            }
+            buf_put_varint(&records, idx - 1);
+        }
+    }
+    free(line);
+    fclose(in);
+
+    byte_buf header = {NULL, 0, 0};
+    buf_put(&header, TRACE_MAGIC, TRACE_MAGIC_LEN);
+    buf_put_varint(&header, words.cnt);
+    buf_put_varint(&header, nrecords);
+
+    if (ok) {
+        FILE *out = fopen(out_name, "w");
+        ok = out != NULL;
+        if (ok) {
+            ok = fwrite(header.data, 1, header.len, out) == header.len &&
+                 fwrite(strs.data, 1, strs.len, out) == strs.len &&
+                 fwrite(records.data, 1, records.len, out) == records.len;
+            ok = fclose(out) == 0 && ok;
+        }
+        if (!ok)
+            report(1, "ERROR: Could not write compiled trace '%s'",
+                   out_name);
+    }
+
+    for (size_t i = 0; i < words.cap; i++) {
+        if (words.slots[i].name)
+            free_string(words.slots[i].name);
+    }
+    table_clear(&words);
+    byte_buf *bufs[] = {&header, &strs, &records};
+    for (size_t i = 0; i < sizeof(bufs) / sizeof(bufs[0]); i++) {
+        if (bufs[i]->data)
+            free_block(bufs[i]->data, bufs[i]->cap);
+    }
+    return ok;
+}
@@ -22,8 +22,11 @@ struct CELE {
     cmd_ptr next;
 };
 
-/* Optionally supply function that gets invoked when parameter changes */
-typedef void (*setter_function)(int oldval);
+/*
+ * Optionally supply function that gets invoked when parameter changes.
+ * It returns false when it rejects the new value, after restoring oldval.
+ */
+typedef bool (*setter_function)(int oldval);
 
 /* Integer-valued parameters */
 typedef struct PELE param_ele, *param_ptr;
@@ -76,4 +79,11 @@ int cmd_select(int nfds,
  */
 bool run_console(char *infile_name);
 
+/*
+ * Compile the commands of file in_name into a binary trace out_name, which
+ * run_console and source execute without parsing any text.
+ * Return true if successful.
+ */
+bool compile_trace(char *in_name, char *out_name);
+
 #endif /* LAB0_CONSOLE_H */
@@ -0,0 +1,128 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "cqueue.h"
+#include "harness.h"
+
+/*
+ * Create empty queue.
+ * Return NULL if could not allocate space.
+ */
+cqueue_t *cq_new()
+{
+    cqueue_t *q = malloc(sizeof(cqueue_t));
+    if (!q)
+        return NULL;
+    clist_ele_t *dummy = malloc(sizeof(clist_ele_t));
+    if (!dummy) {
+        free(q);
+        return NULL;
+    }
+    dummy->value = NULL;
+    atomic_init(&dummy->next, NULL);
+    q->head = q->tail = dummy;
+    pthread_mutex_init(&q->head_lock, NULL);
+    pthread_mutex_init(&q->tail_lock, NULL);
+    atomic_init(&q->size, 0);
+    return q;
+}
+
+/* Free all storage used by queue */
+void cq_free(cqueue_t *q)
+{
+    if (!q)
+        return;
+    clist_ele_t *tmp = q->head, *pre = NULL;
+    while (tmp) {
+        pre = tmp;
+        tmp = atomic_load_explicit(&tmp->next, memory_order_relaxed);
+        if (pre->value)
+            free(pre->value);
+        free(pre);
+    }
+    pthread_mutex_destroy(&q->head_lock);
+    pthread_mutex_destroy(&q->tail_lock);
+    free(q);
+}
+
+/*
+ * Attempt to insert element at tail of queue.
+ * Return true if successful.
+ * Return false if q is NULL or could not allocate space.
+ * Allocation and copy are done before taking the lock, which only guards
+ * linking the element.
+ */
+bool cq_insert_tail(cqueue_t *q, char *s)
+{
+    if (!q)
+        return false;
+    clist_ele_t *newt = malloc(sizeof(clist_ele_t));
+    if (!newt)
+        return false;
+    size_t len = strlen(s);
+    newt->value = malloc(sizeof(char) * (len + 1));
+    if (!newt->value) {
+        free(newt);
+        return false;
+    }
+    memcpy(newt->value, s, len + 1);
+    atomic_init(&newt->next, NULL);
+
+    // Count the element before it can be removed, so size never drops
+    // below zero.
+    atomic_fetch_add_explicit(&q->size, 1, memory_order_relaxed);
+
+    pthread_mutex_lock(&q->tail_lock);
+    // Release pairs with the acquire in cq_remove_head, publishing value.
+    atomic_store_explicit(&q->tail->next, newt, memory_order_release);
+    q->tail = newt;
+    pthread_mutex_unlock(&q->tail_lock);
+    return true;
+}
+
+/*
+ * Attempt to remove element from head of queue.
+ * Return true if successful.
+ * Return false if queue is NULL or empty.
+ * The first real element becomes the new dummy.  Its string is taken over
+ * under the lock, copied and freed once the lock is released.
+ */
+bool cq_remove_head(cqueue_t *q, char *sp, size_t bufsize)
+{
+    if (!q)
+        return false;
+
+    pthread_mutex_lock(&q->head_lock);
+    clist_ele_t *dummy = q->head;
+    clist_ele_t *first =
+        atomic_load_explicit(&dummy->next, memory_order_acquire);
+    if (!first) {
+        pthread_mutex_unlock(&q->head_lock);
+        return false;
+    }
+    char *value = first->value;
+    first->value = NULL;
+    q->head = first;
+    pthread_mutex_unlock(&q->head_lock);
+
+    atomic_fetch_sub_explicit(&q->size, 1, memory_order_relaxed);
+    if (sp && bufsize > 0) {
+        strncpy(sp, value, bufsize - 1);
+        *(sp + bufsize - 1) = '\0';
+    }
+    free(value);
+    free(dummy);
+    return true;
+}
+
+/*
+ * Return number of elements in queue.
+ * Return 0 if q is NULL or empty
+ */
+int cq_size(cqueue_t *q)
+{
+    if (!q)
+        return 0;
+    return atomic_load_explicit(&q->size, memory_order_relaxed);
+}
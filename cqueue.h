@@ -0,0 +1,85 @@
+#ifndef LAB0_CQUEUE_H
+#define LAB0_CQUEUE_H
+
+/*
+ * This program implements a queue that can be shared by several threads,
+ * inserting at the tail and removing from the head concurrently.
+ *
+ * It uses the two-lock algorithm of Michael and Scott: the list always
+ * starts with a dummy element, so that producers only ever touch the tail
+ * and consumers only ever touch the head, each side under its own lock.
+ */
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+/* Data structure declarations */
+
+/* Size of a cache line, used to keep both ends of the queue apart */
+#define CACHE_LINE_SIZE 64
+
+/* Linked list element */
+typedef struct CQELE {
+    /* Pointer to array holding string.
+     * This array needs to be explicitly allocated and freed
+     */
+    char *value;
+    /* Written by producers while consumers may be reading it */
+    _Atomic(struct CQELE *) next;
+} clist_ele_t;
+
+/* Concurrent queue structure */
+typedef struct {
+    clist_ele_t *head; /* Dummy element, guarded by head_lock */
+    pthread_mutex_t head_lock;
+    char pad1[CACHE_LINE_SIZE];
+    clist_ele_t *tail; /* Last element, guarded by tail_lock */
+    pthread_mutex_t tail_lock;
+    char pad2[CACHE_LINE_SIZE];
+    atomic_int size; /* Memorizing the size of queue */
+} cqueue_t;
+
+/* Operations on concurrent queue */
+
+/*
+ * Create empty queue.
+ * Return NULL if could not allocate space.
+ */
+cqueue_t *cq_new();
+
+/*
+ * Free ALL storage used by queue.
+ * No effect if q is NULL.
+ * No other thread may be using the queue.
+ */
+void cq_free(cqueue_t *q);
+
+/*
+ * Attempt to insert element at tail of queue.  Safe to call concurrently.
+ * Return true if successful.
+ * Return false if q is NULL or could not allocate space.
+ * Argument s points to the string to be stored.
+ * The function must explicitly allocate space and copy the string into it.
+ */
+bool cq_insert_tail(cqueue_t *q, char *s);
+
+/*
+ * Attempt to remove element from head of queue.  Safe to call concurrently.
+ * Return true if successful.
+ * Return false if queue is NULL or empty.
+ * If sp is non-NULL and an element is removed, copy the removed string to *sp
+ * (up to a maximum of bufsize-1 characters, plus a null terminator.)
+ * The space used by the list element and the string should be freed.
+ */
+bool cq_remove_head(cqueue_t *q, char *sp, size_t bufsize);
+
+/*
+ * Return number of elements in queue, in O(1).
+ * Return 0 if q is NULL or empty.
+ * While other threads are using the queue, this is only a snapshot.
+ */
+int cq_size(cqueue_t *q);
+
+#endif /* LAB0_CQUEUE_H */
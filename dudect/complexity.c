@@ -0,0 +1,169 @@
+/*
+ * Estimate how the cost of a queue operation grows with the queue length.
+ *
+ * The operation is timed on queues of doubling sizes, and each model
+ * cycles = coef * f(n) is fitted to the timings.  Sizes span several orders
+ * of magnitude, so the fit is made on log(cycles), where every timing weighs
+ * the same however large, rather than on the cycles, which the largest
+ * sizes would dominate.
+ */
+
+/* Our program needs the harness exception API, as qtest.c does */
+#define INTERNAL 1
+
+#include "complexity.h"
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include "constant.h"
+#include "cpucycles.h"
+#include "harness.h"
+
+/* Times an operation is repeated at each size, keeping the median */
+#define COMPLEXITY_REPEATS 7
+
+/*
+ * Timings of constant time operations still grow a little with the queue,
+ * as caches hold less of it, so a model is only preferred to a slower
+ * growing one when it cuts the error by this factor, plus this much for
+ * when every error is small.
+ */
+#define COMPLEXITY_TOLERANCE 1.5
+#define COMPLEXITY_SLACK 0.1
+
+const char *const model_names[number_models] = {
+    "O(1)", "O(log n)", "O(n)", "O(n log n)", "O(n^2)",
+};
+
+static double model(int m, double n)
+{
+    switch (m) {
+    case model_log_n:
+        return log2(n);
+    case model_n:
+        return n;
+    case model_n_log_n:
+        return n * log2(n);
+    case model_n2:
+        return n * n;
+    default:
+        return 1;
+    }
+}
+
+static int cmp_double(const void *a, const void *b)
+{
+    double x = *(const double *) a, y = *(const double *) b;
+    return (x > y) - (x < y);
+}
+
+/*
+ * Median cycles taken by op on a queue of n elements, or -1 if an exception
+ * was raised.  Faults are caught throughout, but only the operation itself
+ * is held to the time limit, as building large queues takes longer.
+ * The harness may resume past a faulting call rather than at its setup,
+ * so each step is checked with error_check() as qtest does.
+ */
+static double time_op(const dut_op_t *op, size_t n)
+{
+    double ticks[COMPLEXITY_REPEATS];
+    for (int r = 0; r < COMPLEXITY_REPEATS; r++) {
+        int64_t before = 0, after = 0;
+        if (exception_setup(false))
+            op->setup(n);
+        exception_cancel();
+        if (error_check())
+            return -1;
+        if (exception_setup(true)) {
+            before = cpucycles();
+            op->run();
+            after = cpucycles();
+        }
+        exception_cancel();
+        /* Still free the queue, which is only lost if that faults too */
+        bool failed = error_check();
+        if (exception_setup(false))
+            op->teardown();
+        exception_cancel();
+        if (error_check() || failed)
+            return -1;
+        ticks[r] = after - before;
+    }
+    qsort(ticks, COMPLEXITY_REPEATS, sizeof(double), cmp_double);
+    return ticks[COMPLEXITY_REPEATS / 2];
+}
+
+/*
+ * Fit cycles = coef * model(n) in log space, minimizing the squared log
+ * ratios of timings to the model, and return their root mean square.  The
+ * timing at index skip is left out, no timing is when skip is negative.
+ */
+static double fit_error(const complexity_t *c, int m, int skip)
+{
+    double log_coef = 0;
+    for (int i = 0; i < c->points; i++) {
+        if (i != skip)
+            log_coef += log(c->cycles[i] / model(m, c->sizes[i]));
+    }
+    int fitted = c->points - (skip >= 0);
+    log_coef /= fitted;
+
+    double sq = 0;
+    for (int i = 0; i < c->points; i++) {
+        if (i == skip)
+            continue;
+        double d = log(c->cycles[i] / model(m, c->sizes[i])) - log_coef;
+        sq += d * d;
+    }
+    return sqrt(sq / fitted);
+}
+
+/*
+ * Fit every model, leaving out the timing at index skip, and choose one.
+ * Models are listed from the slowest growing one.
+ */
+static int choose_model(const complexity_t *c, double *error, int skip)
+{
+    double min_error = INFINITY;
+    for (int m = 0; m < number_models; m++) {
+        error[m] = fit_error(c, m, skip);
+        min_error = fmin(min_error, error[m]);
+    }
+    int m = 0;
+    while (error[m] > COMPLEXITY_TOLERANCE * min_error + COMPLEXITY_SLACK)
+        m++;
+    return m;
+}
+
+bool estimate_complexity(int op, size_t max_size, complexity_t *c)
+{
+    prepare_strings();
+
+    c->points = 0;
+    for (size_t n = COMPLEXITY_MIN_SIZE;
+         n <= max_size && c->points < COMPLEXITY_MAX_POINTS; n *= 2) {
+        double cycles = time_op(&dut_ops[op], n);
+        if (cycles < 0)
+            return false;
+        c->sizes[c->points] = n;
+        /* A timing of zero cycles would not fit any model */
+        c->cycles[c->points] = fmax(cycles, 1);
+        c->points++;
+    }
+
+    c->best = choose_model(c, c->error, -1);
+    c->second = -1;
+    for (int m = 0; m < number_models; m++) {
+        if (m != c->best &&
+            (c->second < 0 || c->error[m] < c->error[c->second]))
+            c->second = m;
+    }
+
+    int agree = 0;
+    for (int i = 0; i < c->points; i++) {
+        double error[number_models];
+        agree += choose_model(c, error, i) == c->best;
+    }
+    c->confidence = (double) agree / c->points;
+    return true;
+}
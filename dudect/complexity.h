@@ -0,0 +1,49 @@
+#ifndef DUDECT_COMPLEXITY_H
+#define DUDECT_COMPLEXITY_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/* Smallest queue an operation is timed on */
+#define COMPLEXITY_MIN_SIZE 1000
+
+/* Largest queue an operation is timed on, unless told otherwise */
+#define COMPLEXITY_MAX_SIZE 10000000
+
+/* Sizes double from COMPLEXITY_MIN_SIZE, so this covers any int size */
+#define COMPLEXITY_MAX_POINTS 32
+
+/* Growth models fitted to the timings */
+enum {
+    model_1,
+    model_log_n,
+    model_n,
+    model_n_log_n,
+    model_n2,
+    number_models
+};
+
+extern const char *const model_names[number_models];
+
+/* Timings of an operation and how well each model fits them */
+typedef struct {
+    int points;
+    size_t sizes[COMPLEXITY_MAX_POINTS];
+    /* Median cycles taken at each size */
+    double cycles[COMPLEXITY_MAX_POINTS];
+    /* Root mean square of the log ratios of the timings to each model */
+    double error[number_models];
+    /* Model chosen, and the one fitting best among the others */
+    int best, second;
+    /* Share of the timings that can be left out without changing the model */
+    double confidence;
+} complexity_t;
+
+/*
+ * Time queue operation op, as listed in dut_ops, on queues of doubling
+ * sizes up to max_size, and fit the timings to each model.
+ * Return false if a fault or the time limit of the harness stopped it.
+ */
+bool estimate_complexity(int op, size_t max_size, complexity_t *c);
+
+#endif
@@ -7,6 +7,7 @@
 #include <string.h>
 #include <unistd.h>
 #include "cpucycles.h"
+#include "harness.h"
 #include "queue.h"
 #include "random.h"
 
@@ -22,7 +23,21 @@ const int drop_size = 20;
 static queue_t *q = NULL;
 static char random_string[NR_MEASURE][8];
 static int random_string_iter = 0;
-enum { test_insert_tail, test_size };
+
+/* Queue length of the fixed class */
+static const uint16_t fixed_length = 0;
+
+/* Queues of the random class hold fewer elements than this */
+static const uint16_t max_length = 10000;
+
+/* Queues and strings set up for each measurement of a batch */
+static queue_t *queues[NR_MEASURE];
+static char *strs[NR_MEASURE];
+
+/* String inserted by the measured operation */
+static char *str;
+/* Buffer the measured operation removes into */
+static char removed[8];
 
 /* Implement the necessary queue interface to simulation */
 void init_dut(void)
@@ -36,50 +51,223 @@ char *get_random_string(void)
     return random_string[random_string_iter];
 }
 
+void prepare_strings(void)
+{
+    for (size_t i = 0; i < NR_MEASURE; ++i) {
+        /* Generate random string */
+        randombytes((uint8_t *) random_string[i], 7);
+        random_string[i][7] = 0;
+    }
+}
+
 void prepare_inputs(uint8_t *input_data, uint8_t *classes)
 {
     randombytes(input_data, number_measurements * chunk_size);
     for (size_t i = 0; i < number_measurements; i++) {
         classes[i] = randombit();
         if (classes[i] == 0)
-            *(uint16_t *) (input_data + i * chunk_size) = 0x00;
+            *(uint16_t *) (input_data + i * chunk_size) = fixed_length;
     }
+    prepare_strings();
+}
 
-    for (size_t i = 0; i < NR_MEASURE; ++i) {
-        /* Generate random string */
-        randombytes((uint8_t *) random_string[i], 7);
-        random_string[i][7] = 0;
-    }
+static void setup_none(int n)
+{
+    (void) n;
+    q = NULL;
+}
+
+static void setup_queue(int n)
+{
+    q = q_new();
+    while (n--)
+        q_insert_head(q, get_random_string());
+    str = get_random_string();
+}
+
+/* Keep the queue non-empty, removing from it must do the work */
+static void setup_nonempty(int n)
+{
+    setup_queue(n + 1);
+}
+
+/* Owned strings are released by the queue, so they come from the harness */
+static void setup_owned(int n)
+{
+    setup_queue(n);
+    str = strdup(str);
+}
+
+static void teardown_none(void) {}
+
+static void teardown_queue(void)
+{
+    q_free(q);
 }
 
+static void teardown_taken(void)
+{
+    free(str);
+    q_free(q);
+}
+
+static void run_new(void)
+{
+    q = q_new();
+}
+
+static void run_free(void)
+{
+    q_free(q);
+}
+
+static void run_insert_head(void)
+{
+    q_insert_head(q, str);
+}
+
+static void run_insert_tail(void)
+{
+    q_insert_tail(q, str);
+}
+
+static void run_insert_head_owned(void)
+{
+    q_insert_head_owned(q, str);
+}
+
+static void run_insert_tail_owned(void)
+{
+    q_insert_tail_owned(q, str);
+}
+
+static void run_remove_head(void)
+{
+    q_remove_head(q, removed, sizeof(removed));
+}
+
+static void run_remove_tail(void)
+{
+    q_remove_tail(q, removed, sizeof(removed));
+}
+
+static void run_remove_head_take(void)
+{
+    str = q_remove_head_take(q);
+}
+
+static void run_size(void)
+{
+    q_size(q);
+}
+
+static void run_reverse(void)
+{
+    q_reverse(q);
+}
+
+static void run_sort(void)
+{
+    q_sort(q);
+}
+
+/* Elements visited, kept so that the walk is not optimized away */
+static volatile int walked;
+
+/*
+ * Visit the first few elements of the queue, a deliberately leaky operation
+ * checking that is_const catches small differences.
+ */
+static void run_leak(void)
+{
+    int cnt = 0;
+    for (list_ele_t *e = q->head; e && cnt < 16; e = e->next)
+        cnt++;
+    walked = cnt;
+}
+
+const dut_op_t dut_ops[number_ops] = {
+    [dut_new] = {"new", setup_none, run_new, teardown_queue},
+    [dut_free] = {"free", setup_queue, run_free, teardown_none},
+    [dut_insert_head] = {"insert_head", setup_queue, run_insert_head,
+                          teardown_queue},
+    [dut_insert_tail] = {"insert_tail", setup_queue, run_insert_tail,
+                          teardown_queue},
+    [dut_insert_head_owned] = {"insert_head_owned", setup_owned,
+                                run_insert_head_owned, teardown_queue},
+    [dut_insert_tail_owned] = {"insert_tail_owned", setup_owned,
+                                run_insert_tail_owned, teardown_queue},
+    [dut_remove_head] = {"remove_head", setup_nonempty, run_remove_head,
+                          teardown_queue},
+    [dut_remove_tail] = {"remove_tail", setup_nonempty, run_remove_tail,
+                          teardown_queue},
+    [dut_remove_head_take] = {"remove_head_take", setup_nonempty,
+                               run_remove_head_take, teardown_taken},
+    [dut_size] = {"size", setup_queue, run_size, teardown_queue},
+    [dut_reverse] = {"reverse", setup_queue, run_reverse, teardown_queue},
+    [dut_sort] = {"sort", setup_queue, run_sort, teardown_queue},
+    [dut_leak] = {"leak", setup_queue, run_leak, teardown_queue},
+};
+
+/* Sum of what warm_queue read, kept so that the reads are not optimized */
+static volatile int touched;
+
+/*
+ * Read the queue header, the elements at both ends with their strings, and
+ * the slot the next insertion takes, so that they are cached whatever the
+ * class.  Queues of the random class are set up far apart in memory,
+ * whereas the empty ones of the fixed class end up side by side, and would
+ * otherwise be cheaper to reach.
+ */
+static void warm_queue(void)
+{
+    if (!q)
+        return;
+    int sum = q->size;
+    if (q->head)
+        sum += q->head->value[0] + q->tail->value[0];
+    if (q->slabs && q->slab_used < q->slabs->cap)
+        sum += q->slabs->slots[q->slab_used].str[0];
+    touched = sum;
+}
+
+/*
+ * Set up the queues of all measurements first, warm them, then time the
+ * operation on each of them in turn, and tear them down at last.  Setting
+ * up a queue of thousands of elements evicts caches that an empty queue
+ * leaves alone, so timing each measurement right after its own setup would
+ * tell the classes apart whatever the operation does.
+ */
 void measure(int64_t *before_ticks,
              int64_t *after_ticks,
              uint8_t *input_data,
              int mode)
 {
-    assert(mode == test_insert_tail || mode == test_size);
-    if (mode == test_insert_tail) {
-        for (size_t i = drop_size; i < number_measurements - drop_size; i++) {
-            char *s = get_random_string();
-            dut_new();
-            dut_insert_head(
-                get_random_string(),
-                *(uint16_t *) (input_data + i * chunk_size) % 10000);
-            before_ticks[i] = cpucycles();
-            dut_insert_tail(s, 1);
-            after_ticks[i] = cpucycles();
-            dut_free();
-        }
-    } else {
-        for (size_t i = drop_size; i < number_measurements - drop_size; i++) {
-            dut_new();
-            dut_insert_head(
-                get_random_string(),
-                *(uint16_t *) (input_data + i * chunk_size) % 10000);
-            before_ticks[i] = cpucycles();
-            dut_size(1);
-            after_ticks[i] = cpucycles();
-            dut_free();
-        }
+    assert(mode >= 0 && mode < number_ops);
+    const dut_op_t *op = &dut_ops[mode];
+    for (size_t i = drop_size; i < number_measurements - drop_size; i++) {
+        op->setup(*(uint16_t *) (input_data + i * chunk_size) % max_length);
+        queues[i] = q;
+        strs[i] = str;
+    }
+    for (size_t i = drop_size; i < number_measurements - drop_size; i++) {
+        q = queues[i];
+        warm_queue();
+    }
+    for (size_t i = drop_size; i < number_measurements - drop_size; i++) {
+        q = queues[i];
+        str = strs[i];
+        int64_t before = cpucycles();
+        op->run();
+        int64_t after = cpucycles();
+        before_ticks[i] = before;
+        after_ticks[i] = after;
+        queues[i] = q;
+        strs[i] = str;
+    }
+    for (size_t i = drop_size; i < number_measurements - drop_size; i++) {
+        q = queues[i];
+        str = strs[i];
+        op->teardown();
     }
 }
@@ -2,37 +2,46 @@
 #define DUDECT_CONSTANT_H
 
 #include <stdint.h>
-#define dut_new()    \
-    {                \
-        q = q_new(); \
-    }
 
-#define dut_size(n)                                \
-    do {                                           \
-        for (int __iter = 0; __iter < n; ++__iter) \
-            q_size(q);                             \
-    } while (0);
+/* Queue operations that can be measured, indexes of dut_ops */
+enum {
+    dut_new,
+    dut_free,
+    dut_insert_head,
+    dut_insert_tail,
+    dut_insert_head_owned,
+    dut_insert_tail_owned,
+    dut_remove_head,
+    dut_remove_tail,
+    dut_remove_head_take,
+    dut_size,
+    dut_reverse,
+    dut_sort,
+    dut_leak,
+    number_ops
+};
 
-#define dut_insert_head(s, n)    \
-    do {                         \
-        int j = n;               \
-        while (j--)              \
-            q_insert_head(q, s); \
-    } while (0);
+/*
+ * How to measure a queue operation.  Each measurement calls setup with the
+ * number of elements drawn for it, times run, then calls teardown.
+ * The state setup leaves behind is kept in q and str, so that measure can
+ * prepare a whole batch before timing any of it.
+ */
+typedef struct {
+    /* Name shown while testing */
+    const char *name;
+    /* Prepare a queue of n elements, and whatever else run needs */
+    void (*setup)(int n);
+    /* The operation being timed */
+    void (*run)(void);
+    /* Release what setup and run left behind */
+    void (*teardown)(void);
+} dut_op_t;
 
-#define dut_insert_tail(s, n)    \
-    do {                         \
-        int j = n;               \
-        while (j--)              \
-            q_insert_tail(q, s); \
-    } while (0);
-
-#define dut_free() \
-    {              \
-        q_free(q); \
-    }
+extern const dut_op_t dut_ops[number_ops];
 
 void init_dut();
+void prepare_strings(void);
 void prepare_inputs(uint8_t *input_data, uint8_t *classes);
 void measure(int64_t *before_ticks,
              int64_t *after_ticks,
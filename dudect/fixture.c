@@ -34,6 +34,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 #include "../console.h"
 #include "../random.h"
 #include "constant.h"
@@ -42,10 +43,43 @@
 #define enough_measurements 10000
 #define test_tries 10
 
+/* Number of thresholds the measurements are cropped at */
+#define number_percentiles 100
+
+/* The uncropped test, one test per threshold, then the second order test */
+#define number_tests (1 + number_percentiles + 1)
+
+/* Tests holding fewer measurements are left out of the verdict */
+#define enough_test_measurements 1000
+
+/*
+ * The second order test only looks at the fastest half of the measurements,
+ * kept by this threshold, as the spread of the slow ones is dominated by
+ * interrupts and cache misses
+ */
+#define second_order_crop 9
+
+/* Sequential tests may decide once they hold this many measurements */
+#define early_measurements (enough_measurements / 10)
+
+int sequential_test = 1;
+int test_budget = 0;
+
 extern const int drop_size;
 extern const size_t chunk_size;
 extern const size_t number_measurements;
-static t_ctx *t;
+static t_ctx t[number_tests];
+
+/*
+ * Cropping thresholds, set from the first early_measurements.  Those are
+ * held back until then, a single batch is too small to place thresholds a
+ * few percent apart.
+ */
+static int64_t percentiles[number_percentiles];
+static bool have_percentiles;
+static int64_t *held_times;
+static uint8_t *held_classes;
+static size_t held;
 
 /* threshold values for Welch's t-test */
 #define t_threshold_bananas                                                  \
@@ -67,31 +101,129 @@ static void differentiate(int64_t *exec_times,
     }
 }
 
-static void update_statistics(int64_t *exec_times, uint8_t *classes)
+static int cmp_ticks(const void *a, const void *b)
 {
-    for (size_t i = 0; i < number_measurements; i++) {
+    int64_t x = *(const int64_t *) a, y = *(const int64_t *) b;
+    return (x > y) - (x < y);
+}
+
+/*
+ * Set the cropping thresholds from the count measurements in exec_times:
+ * threshold i keeps the fastest 1 - 0.5^(10 * (i + 1) / number_percentiles)
+ * of the measurements, so thresholds get denser towards the fast end of the
+ * distribution.
+ */
+static void prepare_percentiles(int64_t *exec_times, size_t count)
+{
+    int64_t *sorted = calloc(count, sizeof(int64_t));
+    if (!sorted)
+        die();
+    size_t n = 0;
+    for (size_t i = 0; i < count; i++) {
+        if (exec_times[i] > 0)
+            sorted[n++] = exec_times[i];
+    }
+    qsort(sorted, n, sizeof(int64_t), cmp_ticks);
+    for (size_t i = 0; i < number_percentiles; i++) {
+        double which =
+            1 - pow(0.5, 10 * (double) (i + 1) / number_percentiles);
+        size_t pos = (size_t) (which * n);
+        percentiles[i] = n ? sorted[pos < n ? pos : n - 1] : 0;
+    }
+    free(sorted);
+    have_percentiles = true;
+}
+
+static void update_statistics(int64_t *exec_times,
+                              uint8_t *classes,
+                              size_t count)
+{
+    for (size_t i = 0; i < count; i++) {
         int64_t difference = exec_times[i];
         /* Cpu cycle counter overflowed or dropped measurement */
         if (difference <= 0) {
             continue;
         }
         /* do a t-test on the execution time */
-        t_push(t, difference, classes[i]);
+        t_push(&t[0], difference, classes[i]);
+
+        /* do a t-test on cropped execution times, for several thresholds */
+        for (size_t crop = 0; crop < number_percentiles; crop++) {
+            if (difference < percentiles[crop])
+                t_push(&t[1 + crop], difference, classes[i]);
+        }
+
+        /*
+         * do a second order test, on the squared distance to the mean, once
+         * the mean of the cropped test it is taken from has settled
+         */
+        t_ctx *base = &t[1 + second_order_crop];
+        if (difference < percentiles[second_order_crop] &&
+            base->n[0] + base->n[1] > enough_test_measurements) {
+            double centered = difference - base->mean[classes[i]];
+            t_push(&t[number_tests - 1], centered * centered, classes[i]);
+        }
+    }
+}
+
+/*
+ * The test with the largest t statistic, among those holding at least
+ * min_n measurements.  Return NULL if there is none.
+ */
+static t_ctx *max_test(double min_n)
+{
+    t_ctx *ret = NULL;
+    double max = 0;
+    for (size_t i = 0; i < number_tests; i++) {
+        if (t[i].n[0] + t[i].n[1] < min_n)
+            continue;
+        double x = fabs(t_compute(&t[i]));
+        if (max < x) {
+            max = x;
+            ret = &t[i];
+        }
     }
+    return ret;
 }
 
-static bool report(void)
+/*
+ * Print the statistics gathered so far and tell whether they are conclusive.
+ * In sequential mode, a leak is reported as soon as the t statistic goes
+ * beyond t_threshold_bananas, and constant time as soon as the t statistic,
+ * grown as the square root of the number of measurements, would still stay
+ * below t_threshold_moderate after enough_measurements.  That projection
+ * covers every test on course to hold enough_test_measurements by then, as
+ * the fastest cropped tests are the ones to reveal small leaks.  When final
+ * is set, decide on whatever has been gathered.
+ */
+static int report(bool final)
 {
-    double max_t = fabs(t_compute(t));
-    double number_traces_max_t = t->n[0] + t->n[1];
+    double number_traces = t[0].n[0] + t[0].n[1];
+    t_ctx *tmax = max_test(enough_test_measurements);
+    double max_t = tmax ? fabs(t_compute(tmax)) : 0;
+    double number_traces_max_t = tmax ? tmax->n[0] + tmax->n[1] : number_traces;
     double max_tau = max_t / sqrt(number_traces_max_t);
 
     printf("\033[A\033[2K");
-    printf("meas: %7.2lf M, ", (number_traces_max_t / 1e6));
-    if (number_traces_max_t < enough_measurements) {
+    printf("meas: %7.2lf M, ", (number_traces / 1e6));
+    double needed = sequential_test || final ? early_measurements
+                                             : enough_measurements;
+    if (number_traces < needed) {
         printf("not enough measurements (%.0f still to go).\n",
-               enough_measurements - number_traces_max_t);
-        return false;
+               needed - number_traces);
+        return final ? verdict_inconclusive : verdict_pending;
+    }
+
+    /*
+     * Without a test holding enough measurements, nothing can be told yet.
+     * Keep measuring while the budget allows, giving up after
+     * enough_measurements when there is none.
+     */
+    if (!tmax) {
+        printf("no test holds enough measurements yet.\n");
+        if (final || (!test_budget && number_traces >= enough_measurements))
+            return verdict_inconclusive;
+        return verdict_pending;
     }
 
     /*
@@ -108,16 +240,19 @@ static bool report(void)
     printf("max t: %+7.2f, max tau: %.2e, (5/tau)^2: %.2e.\n", max_t, max_tau,
            (double) (5 * 5) / (double) (max_tau * max_tau));
 
-    if (max_t > t_threshold_bananas) {
-        return false;
-    } else if (max_t > t_threshold_moderate) {
-        return false;
-    } else { /* max_t < t_threshold_moderate */
-        return true;
-    }
+    if (max_t > t_threshold_bananas)
+        return verdict_leaky;
+    if (final || number_traces >= enough_measurements)
+        return max_t > t_threshold_moderate ? verdict_leaky : verdict_constant;
+    double growth = enough_measurements / number_traces;
+    t_ctx *tproj = max_test(enough_test_measurements / growth);
+    if (sequential_test && tproj &&
+        fabs(t_compute(tproj)) * sqrt(growth) < t_threshold_moderate)
+        return verdict_constant;
+    return verdict_pending;
 }
 
-static bool doit(int mode)
+static int doit(int mode, bool final)
 {
     int64_t *before_ticks = calloc(number_measurements + 1, sizeof(int64_t));
     int64_t *after_ticks = calloc(number_measurements + 1, sizeof(int64_t));
@@ -135,8 +270,21 @@ static bool doit(int mode)
 
     measure(before_ticks, after_ticks, input_data, mode);
     differentiate(exec_times, before_ticks, after_ticks);
-    update_statistics(exec_times, classes);
-    bool ret = report();
+    if (have_percentiles) {
+        update_statistics(exec_times, classes, number_measurements);
+    } else {
+        for (size_t i = 0; i < number_measurements; i++) {
+            if (exec_times[i] <= 0)
+                continue;
+            held_times[held] = exec_times[i];
+            held_classes[held++] = classes[i];
+        }
+        if (held >= early_measurements) {
+            prepare_percentiles(held_times, held);
+            update_statistics(held_times, held_classes, held);
+        }
+    }
+    int ret = report(final);
 
     free(before_ticks);
     free(after_ticks);
@@ -150,46 +298,48 @@ static bool doit(int mode)
 static void init_once(void)
 {
     init_dut();
-    t_init(t);
+    for (size_t i = 0; i < number_tests; i++)
+        t_init(&t[i]);
+    have_percentiles = false;
+    held = 0;
+    if (!held_times) {
+        size_t cap = early_measurements + number_measurements;
+        held_times = calloc(cap, sizeof(int64_t));
+        held_classes = calloc(cap, sizeof(uint8_t));
+        if (!held_times || !held_classes)
+            die();
+    }
 }
 
-bool is_insert_tail_const(void)
+static double now_ms(void)
 {
-    bool result = false;
-    t = malloc(sizeof(t_ctx));
-
-    for (int cnt = 0; cnt < test_tries; ++cnt) {
-        printf("Testing insert_tail...(%d/%d)\n\n", cnt, test_tries);
-        init_once();
-        for (int i = 0;
-             i <
-             enough_measurements / (number_measurements - drop_size * 2) + 1;
-             ++i)
-            result = doit(0);
-        printf("\033[A\033[2K\033[A\033[2K");
-        if (result == true)
-            break;
-    }
-    free(t);
-    return result;
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec * 1e-6;
 }
 
-bool is_size_const(void)
+/*
+ * Run the test of the operation measured in the given mode until it looks
+ * constant time, giving up after test_tries attempts, or once test_budget
+ * milliseconds have passed.  Return the verdict of the last attempt.
+ */
+int is_const(int mode)
 {
-    bool result = false;
-    t = malloc(sizeof(t_ctx));
+    const char *name = dut_ops[mode].name;
+    int verdict = verdict_pending;
+    double deadline = now_ms() + test_budget;
+
     for (int cnt = 0; cnt < test_tries; ++cnt) {
-        printf("Testing size...(%d/%d)\n\n", cnt, test_tries);
+        printf("Testing %s...(%d/%d)\n\n", name, cnt, test_tries);
         init_once();
-        for (int i = 0;
-             i <
-             enough_measurements / (number_measurements - drop_size * 2) + 1;
-             ++i)
-            result = doit(1);
+        do {
+            bool final = test_budget > 0 && now_ms() >= deadline;
+            verdict = doit(mode, final);
+        } while (verdict == verdict_pending);
         printf("\033[A\033[2K\033[A\033[2K");
-        if (result == true)
+        if (verdict == verdict_constant ||
+            (test_budget > 0 && now_ms() >= deadline))
             break;
     }
-    free(t);
-    return result;
+    return verdict;
 }
@@ -4,8 +4,22 @@
 #include <stdbool.h>
 #include "constant.h"
 
-/* Interface to test if function is constant */
-bool is_insert_tail_const(void);
-bool is_size_const(void);
+/* Stop as soon as the verdict is clear, rather than after a fixed count */
+extern int sequential_test;
+
+/* Milliseconds each test may take, 0 for no limit */
+extern int test_budget;
+
+/* Outcome of a constant time test */
+enum {
+    verdict_pending,
+    verdict_leaky,
+    verdict_constant,
+    /* The measurements ran out before telling anything */
+    verdict_inconclusive
+};
+
+/* Interface to test if function is constant, return its verdict */
+int is_const(int op);
 
 #endif
@@ -1,12 +1,16 @@
 /* Test support code */
 
+#include <pthread.h>
 #include <setjmp.h>
 #include <signal.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 #include <unistd.h>
 
+#include "random.h"
 #include "report.h"
 
 /* Our program needs to use regular malloc/free */
@@ -24,6 +28,9 @@
 /* Value at end of every block */
 #define MAGICFOOTER 0xbeefdead
 
+/* Value at start of blocks allocated in fast mode */
+#define MAGICFAST 0xfa57b10c
+
 /* Byte to fill newly malloced space with */
 #define FILLCHAR 0x55
 
@@ -35,6 +42,9 @@
  */
 typedef struct BELE {
     struct BELE *next, *prev;
+    uint64_t birth; /* Allocation time in nanoseconds, when profiled */
+    uint32_t site;  /* Allocation site of the block in the profile */
+    uint32_t epoch; /* Profile the block is recorded in, 0 if none */
     size_t payload_size;
     size_t magic_header; /* Marker to see if block seems legitimate */
     unsigned char payload[0];
@@ -44,11 +54,68 @@ typedef struct BELE {
 static block_ele_t *allocated = NULL;
 static size_t allocated_count = 0;
 
+/* Bytes requested by allocated blocks, and their peak since last reset */
+static size_t allocated_bytes = 0;
+static size_t peak_bytes = 0;
+
+/*
+ * Open-addressing hash set holding the address of every allocated block,
+ * with linear probing.  It lets cautious mode check that a block is
+ * allocated in constant time, instead of walking the allocated list.
+ * Blocks allocated in fast mode are held with LIVE_FAST set in the address.
+ */
+static uintptr_t *live_set = NULL;
+static size_t live_cap = 0; /* Number of buckets, always a power of 2 */
+
+/* Initial number of buckets, the set doubles when half full */
+#define LIVE_SET_MIN_CAP 1024
+
+/* Blocks are aligned, so the low bit of their address is free for a tag */
+#define LIVE_FAST ((uintptr_t) 1)
+
+/*
+ * In fast mode, payload sizes are rounded up to a multiple of
+ * FAST_CLASS_SIZE, and freed blocks of the FAST_CLASSES smallest size
+ * classes are kept for reuse, up to FAST_CACHE_MAX blocks per class.
+ * Larger blocks go straight back to free.
+ */
+#define FAST_CLASS_SIZE 16
+#define FAST_CLASSES 16
+#define FAST_CACHE_MAX 65536
+
+/* Free blocks of each size class, chained through next */
+static block_ele_t *fast_cache[FAST_CLASSES];
+static size_t fast_cached[FAST_CLASSES];
+
+static harness_stats_t stats;
+
+/*
+ * Allocation profile.  Sites are hashed by address into sites, with linear
+ * probing.  Once all but one entry are taken, new sites are merged into
+ * the extra entry at index PROFILE_MAX_SITES, whose address is NULL.
+ * Blocks remember the epoch of the profile they were recorded in, so that
+ * blocks recorded before the profile was restarted are ignored when freed.
+ */
+static struct {
+    alloc_site_t sites[PROFILE_MAX_SITES + 1];
+    size_t nsites;
+    size_t size_classes[PROFILE_SIZE_CLASSES];
+    size_t live_bytes, peak_bytes;
+    uint32_t epoch;
+} prof;
+static bool profile_mode = false;
+
 /* Percent probability of malloc failure */
 int fail_probability = 0;
 
+/* Generator deciding which allocations fail */
+static prng_t fail_gen;
+
 static bool cautious_mode = true;
 static bool noallocate_mode = false;
+static bool threaded_mode = false;
+static bool fast_mode = false;
+static pthread_mutex_t alloc_lock = PTHREAD_MUTEX_INITIALIZER;
 static bool error_occurred = false;
 static char *error_message = "";
 
@@ -68,15 +135,108 @@ static bool time_limited = false;
 /* Should this allocation fail? */
 static bool fail_allocation()
 {
-    double weight = (double) random() / RAND_MAX;
+    double weight = (prng_next(&fail_gen) >> 11) * 0x1.0p-53;
     return (weight < 0.01 * fail_probability);
 }
 
+/* Bucket where the search for the block at address a starts */
+static inline size_t live_bucket(uintptr_t a)
+{
+    /* Blocks are aligned, so the low bits carry no information */
+    uint64_t h = (a >> 4) * 0x9e3779b97f4a7c15ULL;
+    return (size_t) (h >> 32) & (live_cap - 1);
+}
+
+/* Return bucket holding block b, or the empty bucket where it would go */
+static size_t live_find(const block_ele_t *b)
+{
+    uintptr_t a = (uintptr_t) b;
+    size_t i = live_bucket(a);
+    while (live_set[i] && (live_set[i] & ~LIVE_FAST) != a)
+        i = (i + 1) & (live_cap - 1);
+    return i;
+}
+
+/*
+ * Whether block b is allocated.  If so, set *fast to whether it was
+ * allocated in fast mode.
+ */
+static bool live_contains(const block_ele_t *b, bool *fast)
+{
+    if (!live_cap)
+        return false;
+    uintptr_t e = live_set[live_find(b)];
+    *fast = e & LIVE_FAST;
+    return e != 0;
+}
+
+/*
+ * Rehash every block into a set of cap buckets.
+ * Return false if could not allocate space.
+ */
+static bool live_resize(size_t cap)
+{
+    uintptr_t *old = live_set;
+    size_t old_cap = live_cap;
+    live_set = calloc(cap, sizeof(uintptr_t));
+    if (!live_set) {
+        live_set = old;
+        return false;
+    }
+    live_cap = cap;
+    for (size_t i = 0; i < old_cap; i++) {
+        if (old[i])
+            live_set[live_find((block_ele_t *) (old[i] & ~LIVE_FAST))] =
+                old[i];
+    }
+    free(old);
+    return true;
+}
+
 /*
- * Find header of block, given its payload.
- * Signal error if doesn't seem like legitimate block
+ * Add block b, allocated in fast mode if fast, to the set before it gets
+ * counted in allocated_count
  */
-static block_ele_t *find_header(void *p)
+static void live_insert(block_ele_t *b, bool fast)
+{
+    if (2 * (allocated_count + 1) > live_cap &&
+        !live_resize(live_cap ? 2 * live_cap : LIVE_SET_MIN_CAP)) {
+        report_event(MSG_FATAL, "Couldn't allocate any more memory");
+        error_occurred = true;
+    }
+    live_set[live_find(b)] = (uintptr_t) b | (fast ? LIVE_FAST : 0);
+}
+
+/*
+ * Remove block b from the set, if present.
+ * Later blocks of the probe sequence are shifted back into the hole, so
+ * that no tombstone is needed.
+ */
+static void live_remove(const block_ele_t *b)
+{
+    if (!live_cap)
+        return;
+    size_t mask = live_cap - 1, i = live_find(b);
+    if (!live_set[i])
+        return;
+    for (size_t j = (i + 1) & mask; live_set[j]; j = (j + 1) & mask) {
+        size_t k = live_bucket(live_set[j] & ~LIVE_FAST);
+        /* Move live_set[j] unless its home bucket k lies in (i, j] */
+        if (((j - k) & mask) >= ((j - i) & mask)) {
+            live_set[i] = live_set[j];
+            i = j;
+        }
+    }
+    live_set[i] = 0;
+}
+
+/*
+ * Find header of block, given its payload, and set *fast to whether it was
+ * allocated in fast mode.
+ * Signal error if doesn't seem like legitimate block.  In cautious mode,
+ * return NULL for a block that is not allocated, without reading it.
+ */
+static block_ele_t *find_header(void *p, bool *fast)
 {
     if (!p) {
         report_event(MSG_ERROR, "Attempting to free null block");
@@ -85,22 +245,18 @@ static block_ele_t *find_header(void *p)
 
     block_ele_t *b = (block_ele_t *) ((size_t) p - sizeof(block_ele_t));
     if (cautious_mode) {
-        /* Make sure this is really an allocated block */
-        block_ele_t *ab = allocated;
-        bool found = false;
-        while (ab && !found) {
-            found = ab == b;
-            ab = ab->next;
-        }
-        if (!found) {
+        /* Make sure this is really an allocated block, and of which mode */
+        if (!live_contains(b, fast)) {
             report_event(MSG_ERROR,
                          "Attempted to free unallocated block.  Address = %p",
                          p);
             error_occurred = true;
+            return NULL;
         }
-    }
+    } else
+        *fast = b->magic_header == MAGICFAST;
 
-    if (b->magic_header != MAGICHEADER) {
+    if (b->magic_header != (*fast ? MAGICFAST : MAGICHEADER)) {
         report_event(
             MSG_ERROR,
             "Attempted to free unallocated or corrupted block.  Address = %p",
@@ -119,21 +275,167 @@ static size_t *find_footer(block_ele_t *b)
     return p;
 }
 
+/* Serialize calls to malloc and free in threaded mode */
+static inline void alloc_lock_acquire()
+{
+    if (threaded_mode)
+        pthread_mutex_lock(&alloc_lock);
+}
+
+static inline void alloc_lock_release()
+{
+    if (threaded_mode)
+        pthread_mutex_unlock(&alloc_lock);
+}
+
+/* Size class of payloads of size bytes, -1 if too large to be cached */
+static inline int fast_class(size_t size)
+{
+    size_t c = size ? (size - 1) / FAST_CLASS_SIZE : 0;
+    return c < FAST_CLASSES ? (int) c : -1;
+}
+
+/*
+ * Allocate a block in fast mode, reusing a cached block of the same size
+ * class if there is one.  The block is neither filled nor linked into the
+ * allocated list.
+ */
+static void *fast_malloc(size_t size)
+{
+    int c = fast_class(size);
+    block_ele_t *b;
+    if (c >= 0 && fast_cache[c]) {
+        b = fast_cache[c];
+        fast_cache[c] = b->next;
+        fast_cached[c]--;
+        stats.cache_hits++;
+    } else {
+        size_t cap = c >= 0 ? (size_t) (c + 1) * FAST_CLASS_SIZE : size;
+        b = malloc(cap + sizeof(block_ele_t) + sizeof(size_t));
+        if (!b) {
+            report_event(MSG_FATAL, "Couldn't allocate any more memory");
+            error_occurred = true;
+        }
+    }
+    // cppcheck-suppress nullPointerRedundantCheck
+    b->magic_header = MAGICFAST;
+    // cppcheck-suppress nullPointerRedundantCheck
+    b->payload_size = size;
+    *find_footer(b) = MAGICFOOTER;
+    return (void *) &b->payload;
+}
+
+/* Release a block allocated in fast mode, caching it while in fast mode */
+static void fast_free(block_ele_t *b)
+{
+    int c = fast_class(b->payload_size);
+    b->magic_header = MAGICFREE;
+    *find_footer(b) = MAGICFREE;
+    if (fast_mode && c >= 0 && fast_cached[c] < FAST_CACHE_MAX) {
+        b->next = fast_cache[c];
+        fast_cache[c] = b;
+        fast_cached[c]++;
+    } else
+        free(b);
+}
+
+/* Current time in nanoseconds */
+static uint64_t now_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/* Entry of the profile for allocation site addr */
+static uint32_t profile_site(void *addr)
+{
+    uint64_t h = ((uintptr_t) addr) * 0x9e3779b97f4a7c15ULL;
+    size_t i = (size_t) (h >> 32) & (PROFILE_MAX_SITES - 1);
+    while (prof.sites[i].addr && prof.sites[i].addr != addr)
+        i = (i + 1) & (PROFILE_MAX_SITES - 1);
+    if (!prof.sites[i].addr) {
+        if (prof.nsites == PROFILE_MAX_SITES - 1)
+            return PROFILE_MAX_SITES;
+        prof.sites[i].addr = addr;
+        prof.nsites++;
+    }
+    return (uint32_t) i;
+}
+
+/* Record allocation of block b from site, if profiling */
+static void profile_alloc(block_ele_t *b, void *site)
+{
+    if (!profile_mode) {
+        b->epoch = 0;
+        return;
+    }
+    size_t size = b->payload_size;
+    alloc_site_t *as = &prof.sites[b->site = profile_site(site)];
+    as->blocks++;
+    as->bytes += size;
+    int c = 0;
+    while (c < PROFILE_SIZE_CLASSES - 1 && ((size_t) 1 << c) < size)
+        c++;
+    prof.size_classes[c]++;
+    prof.live_bytes += size;
+    if (prof.live_bytes > prof.peak_bytes)
+        prof.peak_bytes = prof.live_bytes;
+    b->epoch = prof.epoch;
+    b->birth = now_ns();
+}
+
+/* Record release of block b, if it was recorded in the current profile */
+static void profile_free(block_ele_t *b)
+{
+    if (!profile_mode || b->epoch != prof.epoch)
+        return;
+    alloc_site_t *as = &prof.sites[b->site];
+    as->freed++;
+    as->lifetime += (now_ns() - b->birth) * 1e-9;
+    prof.live_bytes -= b->payload_size;
+}
+
+/* Account for a new block of size bytes */
+static inline void count_bytes(size_t size)
+{
+    allocated_bytes += size;
+    if (allocated_bytes > peak_bytes)
+        peak_bytes = allocated_bytes;
+}
+
 /*
  * Implementation of application functions
  */
-void *test_malloc(size_t size)
+/* Allocate a block for the caller at address site */
+static void *alloc_block(size_t size, void *site)
 {
     if (noallocate_mode) {
         report_event(MSG_FATAL, "Calls to malloc disallowed");
         return NULL;
     }
 
-    if (fail_allocation()) {
+    alloc_lock_acquire();
+    /* Fast mode does not draw random numbers unless failures are injected */
+    if ((!fast_mode || fail_probability > 0) && fail_allocation()) {
+        stats.fails++;
+        alloc_lock_release();
         report_event(MSG_WARN, "Malloc returning NULL");
         return NULL;
     }
 
+    stats.mallocs++;
+    if (fast_mode) {
+        void *p = fast_malloc(size);
+        block_ele_t *b = (block_ele_t *) ((size_t) p - sizeof(block_ele_t));
+        live_insert(b, true);
+        profile_alloc(b, site);
+        allocated_count++;
+        count_bytes(size);
+        alloc_lock_release();
+        return p;
+    }
+
     block_ele_t *new_block =
         malloc(size + sizeof(block_ele_t) + sizeof(size_t));
     if (!new_block) {
@@ -156,11 +458,20 @@ void *test_malloc(size_t size)
     if (allocated)
         allocated->prev = new_block;
     allocated = new_block;
+    live_insert(new_block, false);
+    profile_alloc(new_block, site);
     allocated_count++;
+    count_bytes(size);
+    alloc_lock_release();
 
     return p;
 }
 
+void *test_malloc(size_t size)
+{
+    return alloc_block(size, __builtin_return_address(0));
+}
+
 // cppcheck-suppress unusedFunction
 void *test_calloc(size_t nelem, size_t elsize)
 {
@@ -168,7 +479,7 @@ void *test_calloc(size_t nelem, size_t elsize)
      * https://danluu.com/malloc-tutorial/
      */
     size_t size = nelem * elsize;  // TODO: check for overflow
-    void *ptr = test_malloc(size);
+    void *ptr = alloc_block(size, __builtin_return_address(0));
     memset(ptr, 0, size);
     return ptr;
 }
@@ -183,7 +494,14 @@ void test_free(void *p)
     if (!p)
         return;
 
-    block_ele_t *b = find_header(p);
+    alloc_lock_acquire();
+    stats.frees++;
+    bool fast;
+    block_ele_t *b = find_header(p, &fast);
+    if (!b) {
+        alloc_lock_release();
+        return;
+    }
     size_t footer = *find_footer(b);
     if (footer != MAGICFOOTER) {
         report_event(MSG_ERROR,
@@ -192,6 +510,15 @@ void test_free(void *p)
                      p);
         error_occurred = true;
     }
+    profile_free(b);
+    allocated_bytes -= b->payload_size;
+    live_remove(b);
+    if (fast) {
+        fast_free(b);
+        allocated_count--;
+        alloc_lock_release();
+        return;
+    }
     b->magic_header = MAGICFREE;
     *find_footer(b) = MAGICFREE;
     memset(p, FILLCHAR, b->payload_size);
@@ -208,13 +535,14 @@ void test_free(void *p)
 
     free(b);
     allocated_count--;
+    alloc_lock_release();
 }
 
 // cppcheck-suppress unusedFunction
 char *test_strdup(const char *s)
 {
     size_t len = strlen(s) + 1;
-    void *new = test_malloc(len);
+    void *new = alloc_block(len, __builtin_return_address(0));
     if (!new)
         return NULL;
 
@@ -226,6 +554,18 @@ size_t allocation_check()
     return allocated_count;
 }
 
+size_t allocation_bytes(size_t *peak)
+{
+    if (peak)
+        *peak = peak_bytes;
+    return allocated_bytes;
+}
+
+void reset_peak_bytes()
+{
+    peak_bytes = allocated_bytes;
+}
+
 /*
  * Implementation of functions for testing
  */
@@ -233,6 +573,7 @@ size_t allocation_check()
 /*
  * Set/unset cautious mode.
  * In this mode, makes extra sure any block to be freed is currently allocated.
+ * The check is a hash set lookup, so the mode can stay on for large queues.
  */
 void set_cautious_mode(bool cautious)
 {
@@ -248,6 +589,87 @@ void set_noallocate_mode(bool noallocate)
     noallocate_mode = noallocate;
 }
 
+/*
+ * Set/unset threaded mode.
+ * In this mode, calls to malloc and free are serialized with a lock.
+ */
+void set_threaded_mode(bool threaded)
+{
+    threaded_mode = threaded;
+}
+
+/* Seed the generator of malloc failures */
+void harness_seed(uint64_t seed)
+{
+    prng_seed(&fail_gen, seed, HARNESS_STREAM);
+}
+
+/*
+ * Set/unset fast mode.
+ * In this mode, blocks are neither filled nor linked into the allocated
+ * list, only added to the set cautious mode checks, random numbers are
+ * only drawn when failures are injected, and freed blocks are cached by
+ * size class.  Blocks are still counted, so leaks are
+ * detected.  Leaving the mode releases the cached blocks.
+ */
+void set_fast_mode(bool fast)
+{
+    fast_mode = fast;
+    if (fast)
+        return;
+    for (int c = 0; c < FAST_CLASSES; c++) {
+        while (fast_cache[c]) {
+            block_ele_t *b = fast_cache[c];
+            fast_cache[c] = b->next;
+            free(b);
+        }
+        fast_cached[c] = 0;
+    }
+}
+
+/* Copy counters of the harness into *st */
+void harness_stats(harness_stats_t *st)
+{
+    *st = stats;
+    st->cached = 0;
+    for (int c = 0; c < FAST_CLASSES; c++)
+        st->cached += fast_cached[c];
+}
+
+/* Reset counters of the harness, except for the blocks held in the cache */
+void harness_stats_reset()
+{
+    memset(&stats, 0, sizeof(stats));
+}
+
+/*
+ * Set/unset profile mode.
+ * In this mode, the site and size of every allocation are recorded, along
+ * with the lifetime of blocks.  Entering the mode starts a new profile.
+ */
+void set_profile_mode(bool profile)
+{
+    if (profile && !profile_mode) {
+        uint32_t epoch = prof.epoch + 1;
+        memset(&prof, 0, sizeof(prof));
+        prof.epoch = epoch ? epoch : 1;
+    }
+    profile_mode = profile;
+}
+
+/* Copy the current profile into *p, sites in no particular order */
+void alloc_profile(alloc_profile_t *p)
+{
+    p->nsites = 0;
+    for (size_t i = 0; i <= PROFILE_MAX_SITES; i++) {
+        if (prof.sites[i].blocks)
+            p->sites[p->nsites++] = prof.sites[i];
+    }
+    memcpy(p->size_classes, prof.size_classes, sizeof(prof.size_classes));
+    p->live_bytes = prof.live_bytes;
+    p->peak_bytes = prof.peak_bytes;
+}
+
 /*
  * Return whether any errors have occurred since last time set error limit
  */
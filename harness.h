@@ -4,6 +4,7 @@
 #include <setjmp.h>
 #include <stdarg.h>
 #include <stdbool.h>
+#include <stdint.h>
 
 /*
  * This test harness enables us to do stringent testing of code.
@@ -22,9 +23,28 @@ char *test_strdup(const char *s);
 /* Report number of allocated blocks */
 size_t allocation_check();
 
+/*
+ * Report number of bytes requested by allocated blocks, excluding the
+ * overhead of the harness.  Store their peak since last reset in *peak,
+ * unless peak is NULL.
+ */
+size_t allocation_bytes(size_t *peak);
+
+/* Start measuring peak bytes from the bytes currently allocated */
+void reset_peak_bytes();
+
 /* Probability of malloc failing, expressed as percent */
 extern int fail_probability;
 
+/* Stream of the generator of malloc failures, see prng_seed */
+#define HARNESS_STREAM 1
+
+/*
+ * Seed the generator deciding which allocations fail, so that a run can be
+ * reproduced.
+ */
+void harness_seed(uint64_t seed);
+
 /*
  * Set/unset cautious mode.
  * In this mode, makes extra sure any block to be freed is currently allocated.
@@ -37,6 +57,69 @@ void set_cautious_mode(bool cautious);
  */
 void set_noallocate_mode(bool noallocate);
 
+/*
+ * Set/unset threaded mode.
+ * In this mode, calls to malloc and free may come from several threads,
+ * and are serialized with a lock.
+ */
+void set_threaded_mode(bool threaded);
+
+/*
+ * Set/unset fast mode.
+ * In this mode, blocks are counted but neither filled nor listed, random
+ * numbers are only drawn when failures are injected, and freed blocks are
+ * cached for reuse.  Blocks may be freed in either mode.
+ */
+void set_fast_mode(bool fast);
+
+/* Counters of calls to the harness, since program start or last reset */
+typedef struct {
+    size_t mallocs;    /* Blocks handed out by test_malloc */
+    size_t fails;      /* Injected malloc failures */
+    size_t frees;      /* Calls to test_free with a non-NULL block */
+    size_t cache_hits; /* Blocks reused from the cache of fast mode */
+    size_t cached;     /* Free blocks currently held in the cache */
+} harness_stats_t;
+
+/* Copy counters of the harness into *st */
+void harness_stats(harness_stats_t *st);
+
+/* Reset counters of the harness */
+void harness_stats_reset();
+
+/*
+ * Set/unset profile mode.
+ * In this mode, the caller and size of every allocation are recorded,
+ * along with the lifetime of blocks.  Entering the mode starts a new
+ * profile.
+ */
+void set_profile_mode(bool profile);
+
+/* Maximum number of distinct allocation sites in a profile */
+#define PROFILE_MAX_SITES 256
+
+/* Size class i holds blocks of more than 2^(i-1), up to 2^i bytes */
+#define PROFILE_SIZE_CLASSES 32
+
+/* Allocations from one call site */
+typedef struct {
+    void *addr;      /* Return address of the call, NULL for other sites */
+    size_t blocks;   /* Blocks allocated */
+    size_t bytes;    /* Bytes allocated */
+    size_t freed;    /* Blocks freed so far */
+    double lifetime; /* Total lifetime of freed blocks, in seconds */
+} alloc_site_t;
+
+typedef struct {
+    alloc_site_t sites[PROFILE_MAX_SITES + 1];
+    size_t nsites;
+    size_t size_classes[PROFILE_SIZE_CLASSES]; /* Blocks per size class */
+    size_t live_bytes, peak_bytes;
+} alloc_profile_t;
+
+/* Copy the current profile into *p, sites in no particular order */
+void alloc_profile(alloc_profile_t *p);
+
 /*
   Return whether any errors have occurred since last time checked
  */
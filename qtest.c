@@ -1,6 +1,9 @@
 /* Implementation of testing code for queue code */
 
+#define _GNU_SOURCE /* dladdr */
+#include <dlfcn.h>
 #include <getopt.h>
+#include <pthread.h>
 #include <signal.h>
 #include <spawn.h>
 #include <stdio.h>
@@ -11,6 +14,7 @@
 #include <sys/wait.h>
 #include <time.h>
 #include <unistd.h>
+#include "dudect/complexity.h"
 #include "dudect/fixture.h"
 
 /* Our program needs to use regular malloc/free */
@@ -31,7 +35,14 @@
  */
 #include "queue.h"
 
+/* Queue shared between threads, used by the stress command */
+#include "cqueue.h"
+
+/* Ring buffer backend */
+#include "rqueue.h"
+
 #include "console.h"
+#include "random.h"
 #include "report.h"
 
 /* Library of natural sort */
@@ -42,7 +53,6 @@
 /*
  * How large is a queue before it's considered big.
  * This affects how it gets printed
- * and whether cautious mode is used when freeing the list
  */
 #define BIG_QUEUE 30
 static int big_queue_size = BIG_QUEUE;
@@ -52,6 +62,18 @@ static int big_queue_size = BIG_QUEUE;
 /* Queue being tested */
 static queue_t *q = NULL;
 
+/* Which queue implementation the commands operate on */
+#define BACKEND_LIST 0
+#define BACKEND_RING 1
+static int backend = BACKEND_LIST;
+
+/* Queue being tested when the ring buffer backend is selected */
+static rqueue_t *rq = NULL;
+
+/* Capacity of ring buffer queues, up to RING_CAP_MAX */
+#define RING_CAP_MAX (1 << 30)
+static int ring_capacity = 1 << 20;
+
 /* Number of elements in queue */
 static size_t qcnt = 0;
 
@@ -61,6 +83,28 @@ static int fail_count = 0;
 
 static int string_length = MAXSTRING;
 
+/* Which engine the sort command uses */
+#define SORT_MERGE 0
+#define SORT_RADIX 1
+#define SORT_PARALLEL 2
+static int sort_mode = SORT_MERGE;
+
+/* Number of threads of parallel sort, 0 for one per online processor */
+static int sort_threads = 0;
+
+/* Whether the harness runs in fast mode */
+static int fast_mem = 0;
+
+/* Whether the harness records an allocation profile */
+static int mem_profile = 0;
+
+/* Seed of the random generators, taken from the clock unless set */
+static int rand_seed = 0;
+
+/* Stream of the generator of RAND strings, see prng_seed */
+#define RANDSTR_STREAM 2
+static prng_t randstr_gen;
+
 #define MIN_RANDSTR_LEN 5
 #define MAX_RANDSTR_LEN 10
 static const char charset[] = "abcdefghijklmnopqrstuvwxyz";
@@ -72,14 +116,93 @@ static bool do_free(int argc, char *argv[]);
 static bool do_insert_head(int argc, char *argv[]);
 static bool do_insert_tail(int argc, char *argv[]);
 static bool do_remove_head(int argc, char *argv[]);
+static bool do_remove_tail(int argc, char *argv[]);
 static bool do_remove_head_quiet(int argc, char *argv[]);
+static bool do_remove_head_n(int argc, char *argv[]);
+static bool do_insert_head_owned(int argc, char *argv[]);
+static bool do_insert_tail_owned(int argc, char *argv[]);
+static bool do_remove_head_take(int argc, char *argv[]);
 static bool do_reverse(int argc, char *argv[]);
 static bool do_size(int argc, char *argv[]);
 static bool do_sort(int argc, char *argv[]);
 static bool do_show(int argc, char *argv[]);
+static bool do_cstress(int argc, char *argv[]);
+static bool do_hstats(int argc, char *argv[]);
+static bool do_memprof(int argc, char *argv[]);
+static bool do_mem(int argc, char *argv[]);
+static bool do_complexity(int argc, char *argv[]);
+static bool do_leak(int argc, char *argv[]);
 
 static void queue_init();
 
+/* Whether there is a queue for the selected backend */
+static bool have_queue()
+{
+    return backend == BACKEND_RING ? rq != NULL : q != NULL;
+}
+
+/* Switch harness mode, blocks may be allocated in one and freed in other */
+static bool fast_mem_changed(int oldval)
+{
+    set_fast_mode(fast_mem != 0);
+    return true;
+}
+
+/* Start or stop recording the allocation profile */
+static bool mem_profile_changed(int oldval)
+{
+    set_profile_mode(mem_profile != 0);
+    return true;
+}
+
+/* Restart every random generator from rand_seed */
+static bool seed_changed(int oldval)
+{
+    harness_seed((uint64_t) rand_seed);
+    prng_seed(&randstr_gen, (uint64_t) rand_seed, RANDSTR_STREAM);
+    return true;
+}
+
+/* Check new sort engine */
+static bool sortmode_changed(int oldval)
+{
+    if (sort_mode != SORT_MERGE && sort_mode != SORT_RADIX &&
+        sort_mode != SORT_PARALLEL) {
+        report(1, "ERROR: Unknown sort mode %d", sort_mode);
+        sort_mode = oldval;
+        return false;
+    }
+    return true;
+}
+
+/* Check new backend.  The current queue must be freed before switching */
+static bool backend_changed(int oldval)
+{
+    if (backend != BACKEND_LIST && backend != BACKEND_RING) {
+        report(1, "ERROR: Unknown backend %d", backend);
+        backend = oldval;
+        return false;
+    }
+    if (backend != oldval && (q || rq)) {
+        report(1, "ERROR: Free the queue before switching backend");
+        backend = oldval;
+        return false;
+    }
+    return true;
+}
+
+/* Check new ring buffer capacity */
+static bool ringcap_changed(int oldval)
+{
+    if (ring_capacity < 1 || ring_capacity > RING_CAP_MAX) {
+        report(1, "ERROR: Ring capacity must be between 1 and %d",
+               RING_CAP_MAX);
+        ring_capacity = oldval;
+        return false;
+    }
+    return true;
+}
+
 static void console_init()
 {
     add_cmd("new", do_new, "                | Create new queue");
@@ -93,38 +216,155 @@ static void console_init()
     add_cmd("rh", do_remove_head,
             " [str]          | Remove from head of queue.  Optionally compare "
             "to expected value str");
+    add_cmd("rt", do_remove_tail,
+            " [str]          | Remove from tail of queue.  Optionally compare "
+            "to expected value str");
     add_cmd(
         "rhq", do_remove_head_quiet,
         "                | Remove from head of queue without reporting value.");
+    add_cmd("rhn", do_remove_head_n,
+            " n              | Remove n elements from head of queue at once, "
+            "without reporting values.");
+    add_cmd("iho", do_insert_head_owned,
+            " str [n]        | Like ih, but hand over ownership of each string "
+            "to the queue instead of having it copied.");
+    add_cmd("ito", do_insert_tail_owned,
+            " str [n]        | Like it, but hand over ownership of each string "
+            "to the queue instead of having it copied.");
+    add_cmd("rht", do_remove_head_take,
+            " [str]          | Remove from head of queue, taking ownership of "
+            "its string.  Optionally compare to expected value str");
     add_cmd("reverse", do_reverse, "                | Reverse queue");
     add_cmd("sort", do_sort, "                | Sort queue in ascending order");
     add_cmd("size", do_size,
             " [n]            | Compute queue size n times (default: n == 1)");
     add_cmd("show", do_show, "                | Show queue contents");
+    add_cmd("cstress", do_cstress,
+            " [t] [n]        | Measure throughput of concurrent queue with 1 "
+            "up to t threads, each inserting and removing n times. "
+            "(default: t == 4, n == 100000)");
+    add_cmd("hstats", do_hstats,
+            " [n]            | Show harness counters since last call, and "
+            "measure its overhead over n allocations in each mode "
+            "(default: n == 100000)");
+    add_cmd("complexity", do_complexity,
+            " cmd [max] [m]  | Time queue command cmd on queues of 1000 up to "
+            "max elements and fit its cost to O(1), O(log n), O(n), "
+            "O(n log n) and O(n^2), failing unless model m, such as O(nlogn), "
+            "fits best (default: max == 10000000)");
+    add_cmd("leak", do_leak,
+            "                | Check that the constant time test catches a "
+            "walk over the first few elements of the queue");
+    add_cmd("mem", do_mem,
+            "                | Show bytes allocated by the queue, their peak "
+            "since new, and bytes per element");
+    add_cmd("memprof", do_memprof,
+            " [n]            | Show n top allocation sites of the profile "
+            "started by option profile, block sizes, peak live bytes and "
+            "average lifetime (default: n == 10)");
     add_param("length", &string_length, "Maximum length of displayed string",
               NULL);
     add_param("malloc", &fail_probability, "Malloc failure probability percent",
               NULL);
     add_param("fail", &fail_limit,
               "Number of times allow queue operations to return false", NULL);
+    add_param("sortmode", &sort_mode,
+              "Sort engine (0: merge, 1: radix, 2: parallel merge)",
+              sortmode_changed);
+    add_param("threads", &sort_threads,
+              "Number of threads of parallel sort (0: one per processor)",
+              NULL);
+    add_param("backend", &backend,
+              "Queue implementation (0: linked list, 1: ring buffer)",
+              backend_changed);
+    add_param("ringcap", &ring_capacity,
+              "Capacity of ring buffer queues created by new",
+              ringcap_changed);
+    add_param("fastmem", &fast_mem,
+              "Skip filling, tracking and random failures in malloc when "
+              "failure probability is 0, caching freed blocks",
+              fast_mem_changed);
+    add_param("profile", &mem_profile,
+              "Record an allocation profile (setting to 1 restarts it)",
+              mem_profile_changed);
+    add_param("sequential", &sequential_test,
+              "Stop constant time tests as soon as their verdict is clear",
+              NULL);
+    add_param("budget", &test_budget,
+              "Milliseconds a constant time test may take, deciding on the "
+              "measurements so far when they run out (0: no limit)",
+              NULL);
+    add_param("seed", &rand_seed,
+              "Seed of malloc failures and RAND strings (setting it restarts "
+              "them)",
+              seed_changed);
+}
+
+/*
+ * Check in simulation mode that the queue operation op takes the same time
+ * whatever the queue length.
+ */
+static bool do_simulation(int op, int argc, char *argv[])
+{
+    if (argc != 1) {
+        report(1, "%s does not need arguments in simulation mode", argv[0]);
+        return false;
+    }
+    switch (is_const(op)) {
+    case verdict_constant:
+        report(1, "Probably constant time");
+        return true;
+    case verdict_leaky:
+        report(1, "ERROR: Probably not constant time");
+        return false;
+    default:
+        report(1, "ERROR: Could not tell whether constant time");
+        return false;
+    }
+}
+
+/*
+ * Check that the constant time test tells a deliberately leaky operation
+ * apart, one walking over the first few elements of the queue.
+ */
+static bool do_leak(int argc, char *argv[])
+{
+    if (argc != 1) {
+        report(1, "%s takes no arguments", argv[0]);
+        return false;
+    }
+    if (is_const(dut_leak) != verdict_leaky) {
+        report(1, "ERROR: Leak went undetected");
+        return false;
+    }
+    report(1, "Leak detected");
+    return true;
 }
 
 static bool do_new(int argc, char *argv[])
 {
+    if (simulation)
+        return do_simulation(dut_new, argc, argv);
+
     if (argc != 1) {
         report(1, "%s takes no arguments", argv[0]);
         return false;
     }
 
     bool ok = true;
-    if (q) {
+    if (q || rq) {
         report(3, "Freeing old queue");
         ok = do_free(argc, argv);
     }
     error_check();
 
-    if (exception_setup(true))
-        q = q_new();
+    reset_peak_bytes();
+    if (exception_setup(true)) {
+        if (backend == BACKEND_RING)
+            rq = rq_new(ring_capacity);
+        else
+            q = q_new();
+    }
     exception_cancel();
     qcnt = 0;
     show_queue(3);
@@ -134,24 +374,27 @@ static bool do_new(int argc, char *argv[])
 
 static bool do_free(int argc, char *argv[])
 {
+    if (simulation)
+        return do_simulation(dut_free, argc, argv);
+
     if (argc != 1) {
         report(1, "%s takes no arguments", argv[0]);
         return false;
     }
 
     bool ok = true;
-    if (!q)
+    if (!q && !rq)
         report(3, "Warning: Calling free on null queue");
     error_check();
 
-    if (qcnt > big_queue_size)
-        set_cautious_mode(false);
-    if (exception_setup(true))
+    if (exception_setup(true)) {
         q_free(q);
+        rq_free(rq);
+    }
     exception_cancel();
-    set_cautious_mode(true);
 
     q = NULL;
+    rq = NULL;
     qcnt = 0;
     show_queue(3);
 
@@ -164,111 +407,93 @@ static bool do_free(int argc, char *argv[])
 
     return ok && !error_check();
 }
+/* Characters of a RAND string drawn from each 64-bit random number */
+#define RANDSTR_CHARS_PER_DRAW 13
+
 /*
+ * Fill buf with a random string of MIN_RANDSTR_LEN to buf_size - 1
+ * characters.  26^13 < 2^64, so a single draw picks the length and up to
+ * RANDSTR_CHARS_PER_DRAW characters.
  * TODO: Add a buf_size check of if the buf_size may be less
  * than MIN_RANDSTR_LEN.
  */
 static void fill_rand_string(char *buf, size_t buf_size)
 {
-    size_t len = 0;
-    while (len < MIN_RANDSTR_LEN)
-        len = rand() % buf_size;
+    uint64_t x = prng_next(&randstr_gen);
+    size_t len = MIN_RANDSTR_LEN + x % (buf_size - MIN_RANDSTR_LEN);
+    x /= buf_size - MIN_RANDSTR_LEN;
 
     for (size_t n = 0; n < len; n++) {
-        buf[n] = charset[rand() % (sizeof charset - 1)];
+        if (n && n % RANDSTR_CHARS_PER_DRAW == 0)
+            x = prng_next(&randstr_gen);
+        buf[n] = charset[x % (sizeof charset - 1)];
+        x /= sizeof charset - 1;
     }
     buf[len] = '\0';
 }
 
-static bool do_insert_head(int argc, char *argv[])
-{
-    char *lasts = NULL;
-    char randstr_buf[MAX_RANDSTR_LEN];
-    int reps = 1;
-    bool ok = true, need_rand = false;
-    if (argc != 2 && argc != 3) {
-        report(1, "%s needs 1-2 arguments", argv[0]);
-        return false;
-    }
-
-    char *inserts = argv[1];
-    if (argc == 3) {
-        if (!get_int(argv[2], &reps)) {
-            report(1, "Invalid number of insertions '%s'", argv[2]);
-            return false;
-        }
-    }
-
-    if (!strcmp(inserts, "RAND")) {
-        need_rand = true;
-        inserts = randstr_buf;
-    }
-
-    if (!q)
-        report(3, "Warning: Calling insert head on null queue");
-    error_check();
+/* Number of elements inserted by one call to q_insert_{head,tail}_bulk */
+#define INSERT_BATCH 1024
 
-    if (exception_setup(true)) {
-        for (int r = 0; ok && r < reps; r++) {
-            if (need_rand)
-                fill_rand_string(randstr_buf, sizeof(randstr_buf));
-            bool rval = q_insert_head(q, inserts);
-            if (rval) {
-                qcnt++;
-                if (!q->head->value) {
-                    report(1, "ERROR: Failed to save copy of string in list");
-                    ok = false;
-                } else if (r == 0 && inserts == q->head->value) {
-                    report(1,
-                           "ERROR: Need to allocate and copy string for new "
-                           "list element");
-                    ok = false;
-                    break;
-                } else if (r == 1 && lasts == q->head->value) {
-                    report(1,
-                           "ERROR: Need to allocate separate string for each "
-                           "list element");
-                    ok = false;
-                    break;
-                }
-                lasts = q->head->value;
-            } else {
-                fail_count++;
-                if (fail_count < fail_limit)
-                    report(2, "Insertion of %s failed", inserts);
-                else {
-                    report(1,
-                           "ERROR: Insertion of %s failed (%d failures total)",
-                           inserts, fail_count);
-                    ok = false;
-                }
-            }
-            ok = ok && !error_check();
-        }
+/*
+ * Insert strs[0..n) at head or tail of the queue of the selected backend,
+ * through q_insert_{head,tail} for a single string.
+ * Return how many were inserted before the first failure.
+ */
+static int insert_strings(bool at_head, char **strs, int n)
+{
+    if (backend == BACKEND_RING) {
+        int cnt = 0;
+        while (cnt < n && (at_head ? rq_insert_head(rq, strs[cnt])
+                                   : rq_insert_tail(rq, strs[cnt])))
+            cnt++;
+        return cnt;
     }
-    exception_cancel();
-
-    show_queue(3);
-    return ok;
+    if (n == 1)
+        return at_head ? q_insert_head(q, strs[0]) : q_insert_tail(q, strs[0]);
+    return at_head ? q_insert_head_bulk(q, strs, n)
+                   : q_insert_tail_bulk(q, strs, n);
 }
 
-static bool do_insert_tail(int argc, char *argv[])
+/*
+ * Check strings of the cnt elements just inserted at one end of the list,
+ * from strs[0..cnt).  The last one inserted is at that end.
+ */
+static bool check_inserted(bool at_head, char **strs, int cnt)
 {
-    if (simulation) {
-        if (argc != 1) {
-            report(1, "%s does not need arguments in simulation mode", argv[0]);
+    list_ele_t *e = at_head ? q_first(q) : q_last(q);
+    for (int i = cnt - 1; i >= 0; i--) {
+        if (!e->value) {
+            report(1, "ERROR: Failed to save copy of string in list");
             return false;
         }
-        bool ok = is_insert_tail_const();
-        if (!ok) {
-            report(1, "ERROR: Probably not constant time");
+        if (strs[i] == e->value) {
+            report(1,
+                   "ERROR: Need to allocate and copy string for new "
+                   "list element");
             return false;
         }
-        report(1, "Probably constant time");
-        return ok;
+        list_ele_t *older = at_head ? q_next(q, e) : q_prev(q, e);
+        if (i > 0 && e->value == older->value) {
+            report(1,
+                   "ERROR: Need to allocate separate string for each "
+                   "list element");
+            return false;
+        }
+        e = older;
     }
+    return true;
+}
 
-    char randstr_buf[MAX_RANDSTR_LEN];
+/*
+ * Insert reps copies of argv[1] at head or tail of queue, or random strings
+ * if argv[1] equals RAND.
+ * Strings are handed to the queue INSERT_BATCH at a time.
+ */
+static bool do_insert(bool at_head, int argc, char *argv[])
+{
+    static char randstr_buf[INSERT_BATCH][MAX_RANDSTR_LEN];
+    char *strs[INSERT_BATCH];
     int reps = 1;
     bool ok = true, need_rand = false;
     if (argc != 2 && argc != 3) {
@@ -284,34 +509,41 @@ static bool do_insert_tail(int argc, char *argv[])
         }
     }
 
-    if (!strcmp(inserts, "RAND")) {
+    if (!strcmp(inserts, "RAND"))
         need_rand = true;
-        inserts = randstr_buf;
-    }
 
-    if (!q)
-        report(3, "Warning: Calling insert tail on null queue");
+    if (!have_queue())
+        report(3, "Warning: Calling insert %s on null queue",
+               at_head ? "head" : "tail");
     error_check();
 
     if (exception_setup(true)) {
-        for (int r = 0; ok && r < reps; r++) {
-            if (need_rand)
-                fill_rand_string(randstr_buf, sizeof(randstr_buf));
-            bool rval = q_insert_tail(q, inserts);
-            if (rval) {
-                qcnt++;
-                if (!q->head->value) {
-                    report(1, "ERROR: Failed to save copy of string in list");
-                    ok = false;
-                }
-            } else {
+        for (int r = 0; ok && r < reps;) {
+            int batch = reps - r < INSERT_BATCH ? reps - r : INSERT_BATCH;
+            for (int i = 0; i < batch; i++) {
+                if (need_rand) {
+                    fill_rand_string(randstr_buf[i], sizeof(randstr_buf[i]));
+                    strs[i] = randstr_buf[i];
+                } else
+                    strs[i] = inserts;
+            }
+            int cnt = insert_strings(at_head, strs, batch);
+            qcnt += cnt;
+            r += cnt;
+            if (cnt && backend == BACKEND_LIST) {
+                /* Strings are copied into the slots of the ring */
+                ok = check_inserted(at_head, strs, cnt);
+            }
+            if (cnt < batch) {
+                /* Skip the string that could not be inserted */
+                r++;
                 fail_count++;
                 if (fail_count < fail_limit)
-                    report(2, "Insertion of %s failed", inserts);
+                    report(2, "Insertion of %s failed", strs[cnt]);
                 else {
                     report(1,
                            "ERROR: Insertion of %s failed (%d failures total)",
-                           inserts, fail_count);
+                           strs[cnt], fail_count);
                     ok = false;
                 }
             }
@@ -319,11 +551,32 @@ static bool do_insert_tail(int argc, char *argv[])
         }
     }
     exception_cancel();
+
     show_queue(3);
     return ok;
 }
 
-static bool do_remove_head(int argc, char *argv[])
+static bool do_insert_head(int argc, char *argv[])
+{
+    if (simulation)
+        return do_simulation(dut_insert_head, argc, argv);
+
+    return do_insert(true, argc, argv);
+}
+
+static bool do_insert_tail(int argc, char *argv[])
+{
+    if (simulation)
+        return do_simulation(dut_insert_tail, argc, argv);
+
+    return do_insert(false, argc, argv);
+}
+
+/*
+ * Remove from head or tail of queue, optionally comparing the removed string
+ * to argv[1].
+ */
+static bool do_remove(bool at_head, int argc, char *argv[])
 {
     if (argc != 1 && argc != 2) {
         report(1, "%s needs 0-1 arguments", argv[0]);
@@ -356,15 +609,23 @@ static bool do_remove_head(int argc, char *argv[])
     memset(removes + 1, 'X', string_length + STRINGPAD - 1);
     removes[string_length + STRINGPAD] = '\0';
 
-    if (!q)
-        report(3, "Warning: Calling remove head on null queue");
-    else if (!q->head)
-        report(3, "Warning: Calling remove head on empty queue");
+    if (!have_queue())
+        report(3, "Warning: Calling remove %s on null queue",
+               at_head ? "head" : "tail");
+    else if (backend == BACKEND_RING ? !rq_size(rq) : !q->head)
+        report(3, "Warning: Calling remove %s on empty queue",
+               at_head ? "head" : "tail");
     error_check();
 
     bool rval = false;
-    if (exception_setup(true))
-        rval = q_remove_head(q, removes, string_length + 1);
+    if (exception_setup(true)) {
+        if (backend == BACKEND_RING)
+            rval = at_head ? rq_remove_head(rq, removes, string_length + 1)
+                           : rq_remove_tail(rq, removes, string_length + 1);
+        else
+            rval = at_head ? q_remove_head(q, removes, string_length + 1)
+                           : q_remove_tail(q, removes, string_length + 1);
+    }
     exception_cancel();
 
     if (rval) {
@@ -383,8 +644,9 @@ static bool do_remove_head(int argc, char *argv[])
             i++;
         if (i != string_length + STRINGPAD) {
             report(1,
-                   "ERROR: copying of string in remove_head overflowed "
-                   "destination buffer.");
+                   "ERROR: copying of string in remove_%s overflowed "
+                   "destination buffer.",
+                   at_head ? "head" : "tail");
             ok = false;
         } else {
             report(2, "Removed %s from queue", removes);
@@ -414,23 +676,46 @@ static bool do_remove_head(int argc, char *argv[])
     return ok && !error_check();
 }
 
+static bool do_remove_head(int argc, char *argv[])
+{
+    if (simulation)
+        return do_simulation(dut_remove_head, argc, argv);
+
+    return do_remove(true, argc, argv);
+}
+
+static bool do_remove_tail(int argc, char *argv[])
+{
+    if (simulation)
+        return do_simulation(dut_remove_tail, argc, argv);
+
+    return do_remove(false, argc, argv);
+}
+
 static bool do_remove_head_quiet(int argc, char *argv[])
 {
+    if (simulation)
+        return do_simulation(dut_remove_head, argc, argv);
+
     if (argc != 1) {
         report(1, "%s takes no arguments", argv[0]);
         return false;
     }
 
     bool ok = true;
-    if (!q)
+    if (!have_queue())
         report(3, "Warning: Calling remove head on null queue");
-    else if (!q->head)
+    else if (backend == BACKEND_RING ? !rq_size(rq) : !q->head)
         report(3, "Warning: Calling remove head on empty queue");
     error_check();
 
     bool rval = false;
-    if (exception_setup(true))
-        rval = q_remove_head(q, NULL, 0);
+    if (exception_setup(true)) {
+        if (backend == BACKEND_RING)
+            rval = rq_remove_head(rq, NULL, 0);
+        else
+            rval = q_remove_head(q, NULL, 0);
+    }
     exception_cancel();
 
     if (rval) {
@@ -450,20 +735,226 @@ static bool do_remove_head_quiet(int argc, char *argv[])
     return ok && !error_check();
 }
 
+static bool do_remove_head_n(int argc, char *argv[])
+{
+    int n = 0;
+    if (argc != 2) {
+        report(1, "%s needs 1 argument", argv[0]);
+        return false;
+    }
+    if (!get_int(argv[1], &n) || n < 0) {
+        report(1, "Invalid number of removals '%s'", argv[1]);
+        return false;
+    }
+
+    bool ok = true;
+    if (!have_queue())
+        report(3, "Warning: Calling remove head on null queue");
+    else if (backend == BACKEND_RING ? !rq_size(rq) : !q->head)
+        report(3, "Warning: Calling remove head on empty queue");
+    error_check();
+
+    int cnt = 0;
+    if (exception_setup(true)) {
+        if (backend == BACKEND_RING) {
+            while (cnt < n && rq_remove_head(rq, NULL, 0))
+                cnt++;
+        } else
+            cnt = q_remove_head_bulk(q, NULL, n, 0);
+    }
+    exception_cancel();
+
+    if (cnt < 0 || cnt > n || cnt > qcnt) {
+        report(1, "ERROR: Removed %d elements, out of %d requested", cnt, n);
+        ok = false;
+    } else {
+        qcnt -= cnt;
+        if (cnt == n) {
+            report(2, "Removed %d elements from queue", cnt);
+        } else {
+            fail_count++;
+            if (fail_count < fail_limit)
+                report(2, "Removed only %d of %d elements", cnt, n);
+            else {
+                report(1,
+                       "ERROR: Removed only %d of %d elements (%d failures "
+                       "total)",
+                       cnt, n, fail_count);
+                ok = false;
+            }
+        }
+    }
+
+    show_queue(3);
+    return ok && !error_check();
+}
+
+/*
+ * Insert reps strings at head or tail of queue, each allocated here and
+ * handed over to the queue, which must store it without copying.
+ */
+static bool do_insert_owned(bool at_head, int argc, char *argv[])
+{
+    char randstr_buf[MAX_RANDSTR_LEN];
+    int reps = 1;
+    bool ok = true, need_rand = false;
+    if (argc != 2 && argc != 3) {
+        report(1, "%s needs 1-2 arguments", argv[0]);
+        return false;
+    }
+    if (backend == BACKEND_RING) {
+        report(1, "ERROR: %s is not supported by the ring backend", argv[0]);
+        return false;
+    }
+
+    char *inserts = argv[1];
+    if (argc == 3) {
+        if (!get_int(argv[2], &reps)) {
+            report(1, "Invalid number of insertions '%s'", argv[2]);
+            return false;
+        }
+    }
+
+    if (!strcmp(inserts, "RAND"))
+        need_rand = true;
+
+    if (!q)
+        report(3, "Warning: Calling insert %s on null queue",
+               at_head ? "head" : "tail");
+    error_check();
+
+    for (int r = 0; ok && r < reps; r++) {
+        if (need_rand) {
+            fill_rand_string(randstr_buf, sizeof(randstr_buf));
+            inserts = randstr_buf;
+        }
+        /* Allocated through the harness, so that the queue may free it */
+        char *s = test_strdup(inserts);
+        if (!s) {
+            report(2, "Could not allocate string %s", inserts);
+            continue;
+        }
+        bool rval = false;
+        if (exception_setup(true))
+            rval = at_head ? q_insert_head_owned(q, s)
+                           : q_insert_tail_owned(q, s);
+        exception_cancel();
+
+        if (rval) {
+            qcnt++;
+            list_ele_t *e = at_head ? q_first(q) : q_last(q);
+            if (e->value != s) {
+                report(1, "ERROR: Owned string was copied instead of stored");
+                ok = false;
+            }
+        } else {
+            /* Ownership stays with the caller on failure */
+            test_free(s);
+            fail_count++;
+            if (fail_count < fail_limit)
+                report(2, "Insertion of %s failed", inserts);
+            else {
+                report(1, "ERROR: Insertion of %s failed (%d failures total)",
+                       inserts, fail_count);
+                ok = false;
+            }
+        }
+        ok = ok && !error_check();
+    }
+
+    show_queue(3);
+    return ok;
+}
+
+static bool do_insert_head_owned(int argc, char *argv[])
+{
+    if (simulation)
+        return do_simulation(dut_insert_head_owned, argc, argv);
+
+    return do_insert_owned(true, argc, argv);
+}
+
+static bool do_insert_tail_owned(int argc, char *argv[])
+{
+    if (simulation)
+        return do_simulation(dut_insert_tail_owned, argc, argv);
+
+    return do_insert_owned(false, argc, argv);
+}
+
+static bool do_remove_head_take(int argc, char *argv[])
+{
+    if (simulation)
+        return do_simulation(dut_remove_head_take, argc, argv);
+
+    if (argc != 1 && argc != 2) {
+        report(1, "%s needs 0-1 arguments", argv[0]);
+        return false;
+    }
+    if (backend == BACKEND_RING) {
+        report(1, "ERROR: %s is not supported by the ring backend", argv[0]);
+        return false;
+    }
+
+    bool check = argc > 1;
+    bool ok = true;
+    if (!q)
+        report(3, "Warning: Calling remove head on null queue");
+    else if (!q->head)
+        report(3, "Warning: Calling remove head on empty queue");
+    error_check();
+
+    char *removes = NULL;
+    if (exception_setup(true))
+        removes = q_remove_head_take(q);
+    exception_cancel();
+
+    if (removes) {
+        report(2, "Removed %s from queue", removes);
+        qcnt--;
+        if (check && strcmp(removes, argv[1])) {
+            report(1, "ERROR: Removed value %s != expected value %s", removes,
+                   argv[1]);
+            ok = false;
+        }
+        /* Fails with an error if removes is not a block of the harness */
+        test_free(removes);
+    } else {
+        fail_count++;
+        if (!check && fail_count < fail_limit) {
+            report(2, "Removal from queue failed");
+        } else {
+            report(1, "ERROR: Removal from queue failed (%d failures total)",
+                   fail_count);
+            ok = false;
+        }
+    }
+
+    show_queue(3);
+    return ok && !error_check();
+}
+
 static bool do_reverse(int argc, char *argv[])
 {
+    if (simulation)
+        return do_simulation(dut_reverse, argc, argv);
+
     if (argc != 1) {
         report(1, "%s takes no arguments", argv[0]);
         return false;
     }
 
-    if (!q)
+    if (!have_queue())
         report(3, "Warning: Calling reverse on null queue");
     error_check();
 
     set_noallocate_mode(true);
-    if (exception_setup(true))
-        q_reverse(q);
+    if (exception_setup(true)) {
+        if (backend == BACKEND_RING)
+            rq_reverse(rq);
+        else
+            q_reverse(q);
+    }
     exception_cancel();
 
     set_noallocate_mode(false);
@@ -473,19 +964,8 @@ static bool do_reverse(int argc, char *argv[])
 
 static bool do_size(int argc, char *argv[])
 {
-    if (simulation) {
-        if (argc != 1) {
-            report(1, "%s does not need arguments in simulation mode", argv[0]);
-            return false;
-        }
-        bool ok = is_size_const();
-        if (!ok) {
-            report(1, "ERROR: Probably not constant time");
-            return false;
-        }
-        report(1, "Probably constant time");
-        return ok;
-    }
+    if (simulation)
+        return do_simulation(dut_size, argc, argv);
 
     if (argc != 1 && argc != 2) {
         report(1, "%s takes 0-1 arguments", argv[0]);
@@ -506,13 +986,13 @@ static bool do_size(int argc, char *argv[])
     }
 
     int cnt = 0;
-    if (!q)
+    if (!have_queue())
         report(3, "Warning: Calling size on null queue");
     error_check();
 
     if (exception_setup(true)) {
         for (int r = 0; ok && r < reps; r++) {
-            cnt = q_size(q);
+            cnt = backend == BACKEND_RING ? rq_size(rq) : q_size(q);
             ok = ok && !error_check();
         }
     }
@@ -536,11 +1016,19 @@ static bool do_size(int argc, char *argv[])
 
 bool do_sort(int argc, char *argv[])
 {
+    if (simulation)
+        return do_simulation(dut_sort, argc, argv);
+
     if (argc != 1) {
         report(1, "%s takes no arguments", argv[0]);
         return false;
     }
 
+    if (backend == BACKEND_RING) {
+        report(1, "ERROR: Ring buffer backend does not support sorting");
+        return false;
+    }
+
     if (!q)
         report(3, "Warning: Calling sort on null queue");
     error_check();
@@ -551,18 +1039,24 @@ bool do_sort(int argc, char *argv[])
     error_check();
 
     set_noallocate_mode(true);
-    if (exception_setup(true))
-        q_sort(q);
+    if (exception_setup(true)) {
+        if (sort_mode == SORT_RADIX)
+            q_sort_radix(q);
+        else if (sort_mode == SORT_PARALLEL)
+            q_sort_parallel(q, sort_threads);
+        else
+            q_sort(q);
+    }
     exception_cancel();
     set_noallocate_mode(false);
 
     bool ok = true;
     if (q) {
-        for (list_ele_t *e = q->head; e && --cnt; e = e->next) {
+        for (list_ele_t *e = q_first(q); e && --cnt; e = q_next(q, e)) {
             /* Ensure each element in ascending order */
             /* FIXME: add an option to specify sorting order */
             // if (strcasecmp(e->value, e->next->value) > 0) {
-            if (strnatcasecmp(e->value, e->next->value) > 0) {
+            if (strnatcasecmp(e->value, q_next(q, e)->value) > 0) {
                 report(1, "ERROR: Not sorted in ascending order");
                 ok = false;
                 break;
@@ -581,18 +1075,31 @@ static bool show_queue(int vlevel)
         return true;
 
     int cnt = 0;
-    if (!q) {
+    if (!have_queue()) {
         report(vlevel, "q = NULL");
         return true;
     }
 
+    if (backend == BACKEND_RING) {
+        report_noreturn(vlevel, "q = [");
+        for (; cnt < qcnt && cnt < big_queue_size; cnt++)
+            report_noreturn(vlevel, cnt == 0 ? "%s" : " %s", rq_value(rq, cnt));
+        report(vlevel, cnt < rq_size(rq) ? " ... ]" : "]");
+        return true;
+    }
+
     report_noreturn(vlevel, "q = [");
-    list_ele_t *e = q->head;
+    list_ele_t *e = q_first(q), *pre = NULL;
+    bool linked = true;
     if (exception_setup(true)) {
         while (ok && e && cnt < qcnt) {
             if (cnt < big_queue_size)
                 report_noreturn(vlevel, cnt == 0 ? "%s" : " %s", e->value);
-            e = e->next;
+            /* Walking back from e must lead to the element before it */
+            if ((q->reversed ? e->next : e->prev) != pre)
+                linked = false;
+            pre = e;
+            e = q_next(q, e);
             cnt++;
             ok = ok && !error_check();
         }
@@ -604,6 +1111,12 @@ static bool show_queue(int vlevel)
         return false;
     }
 
+    if (!linked) {
+        report(vlevel, " ... ]");
+        report(vlevel, "ERROR:  prev pointers do not match next pointers");
+        return false;
+    }
+
     if (!e) {
         if (cnt <= big_queue_size)
             report(vlevel, "]");
@@ -630,6 +1143,397 @@ static bool do_show(int argc, char *argv[])
     return show_queue(0);
 }
 
+/* Maximum number of threads of the stress command */
+#define STRESS_MAX_THREADS 64
+
+/* Work of one thread of the stress command */
+typedef struct {
+    cqueue_t *cq;
+    int ops;
+    int insert_fails;
+    int remove_fails;
+} stress_arg_t;
+
+/*
+ * Insert then remove an element, over and over.
+ * Each thread inserts before it removes, so the queue can never be empty
+ * when a thread tries to remove: any failed removal is an error.
+ */
+static void *stress_worker(void *arg)
+{
+    stress_arg_t *sa = arg;
+    char buf[MAX_RANDSTR_LEN];
+    for (int i = 0; i < sa->ops; i++) {
+        if (!cq_insert_tail(sa->cq, "gerbil")) {
+            sa->insert_fails++;
+            continue;
+        }
+        if (!cq_remove_head(sa->cq, buf, sizeof(buf)))
+            sa->remove_fails++;
+    }
+    return NULL;
+}
+
+/* Run the stress test with nthreads threads */
+static bool stress_run(int nthreads, int ops)
+{
+    pthread_t tid[STRESS_MAX_THREADS];
+    stress_arg_t args[STRESS_MAX_THREADS];
+    bool ok = true;
+    double timer;
+    int spawned = 0, insert_fails = 0, remove_fails = 0;
+
+    cqueue_t *cq = cq_new();
+    if (!cq) {
+        report(1, "ERROR: Could not allocate concurrent queue");
+        return false;
+    }
+
+    init_time(&timer);
+    for (; spawned < nthreads; spawned++) {
+        args[spawned] = (stress_arg_t){.cq = cq, .ops = ops};
+        if (pthread_create(&tid[spawned], NULL, stress_worker,
+                           &args[spawned])) {
+            report(1, "ERROR: Could not create thread %d", spawned);
+            ok = false;
+            break;
+        }
+    }
+    for (int i = 0; i < spawned; i++) {
+        pthread_join(tid[i], NULL);
+        insert_fails += args[i].insert_fails;
+        remove_fails += args[i].remove_fails;
+    }
+    double elapsed = delta_time(&timer);
+
+    if (remove_fails) {
+        report(1, "ERROR: %d removals from non-empty queue failed",
+               remove_fails);
+        ok = false;
+    }
+    if (insert_fails)
+        report(2, "%d insertions failed", insert_fails);
+    if (cq_size(cq) != 0) {
+        report(1, "ERROR: Queue size = %d after removing every element",
+               cq_size(cq));
+        ok = false;
+    }
+    cq_free(cq);
+
+    if (ok) {
+        double total = 2.0 * spawned * ops - insert_fails;
+        report(1, "%2d threads: %12.0f ops/sec, %12.0f ops/sec per thread",
+               spawned, total / elapsed, total / elapsed / spawned);
+    }
+    return ok;
+}
+
+static bool do_cstress(int argc, char *argv[])
+{
+    int max_threads = 4, ops = 100000;
+    if (argc > 3) {
+        report(1, "%s takes 0-2 arguments", argv[0]);
+        return false;
+    }
+    if (argc > 1 && (!get_int(argv[1], &max_threads) || max_threads < 1 ||
+                     max_threads > STRESS_MAX_THREADS)) {
+        report(1, "Invalid number of threads '%s' (1 to %d)", argv[1],
+               STRESS_MAX_THREADS);
+        return false;
+    }
+    if (argc > 2 && (!get_int(argv[2], &ops) || ops < 0)) {
+        report(1, "Invalid number of operations '%s'", argv[2]);
+        return false;
+    }
+
+    size_t bcnt = allocation_check();
+    bool ok = true;
+    error_check();
+
+    set_threaded_mode(true);
+    if (exception_setup(false)) {
+        for (int n = 1; ok; n = n * 2 < max_threads ? n * 2 : max_threads) {
+            ok = stress_run(n, ops);
+            if (n == max_threads)
+                break;
+        }
+    }
+    exception_cancel();
+    set_threaded_mode(false);
+
+    if (allocation_check() != bcnt) {
+        report(1, "ERROR: Stress test leaked %lu blocks",
+               allocation_check() - bcnt);
+        ok = false;
+    }
+    return ok && !error_check();
+}
+
+/* Size of blocks allocated by the hstats command */
+#define HSTATS_BLOCK_SIZE 32
+
+/* Blocks allocated at once by the hstats command, before freeing them */
+#define HSTATS_BATCH 1024
+
+/*
+ * Time n allocations then releases of blocks, by batches, with test_malloc
+ * and test_free if harness, with plain malloc and free otherwise.
+ * Return nanoseconds per malloc and free pair.
+ */
+static double hstats_time(bool harness, int n)
+{
+    static void *blocks[HSTATS_BATCH];
+    double timer;
+    init_time(&timer);
+    for (int done = 0; done < n; done += HSTATS_BATCH) {
+        int batch = n - done < HSTATS_BATCH ? n - done : HSTATS_BATCH;
+        for (int i = 0; i < batch; i++)
+            blocks[i] = harness ? test_malloc(HSTATS_BLOCK_SIZE)
+                                : malloc(HSTATS_BLOCK_SIZE);
+        for (int i = 0; i < batch; i++) {
+            if (harness)
+                test_free(blocks[i]);
+            else
+                free(blocks[i]);
+        }
+    }
+    return delta_time(&timer) * 1e9 / n;
+}
+
+static bool do_hstats(int argc, char *argv[])
+{
+    int n = 100000;
+    if (argc > 2) {
+        report(1, "%s takes 0-1 arguments", argv[0]);
+        return false;
+    }
+    if (argc > 1 && (!get_int(argv[1], &n) || n <= 0)) {
+        report(1, "Invalid number of allocations '%s'", argv[1]);
+        return false;
+    }
+
+    harness_stats_t st;
+    harness_stats(&st);
+    report(1,
+           "Harness (%s mode) since last hstats: %lu mallocs, %lu injected "
+           "failures, %lu frees, %lu blocks allocated",
+           fast_mem ? "fast" : "normal", st.mallocs, st.fails, st.frees,
+           allocation_check());
+    report(1, "Fast mode cache: %lu blocks reused, %lu blocks held",
+           st.cache_hits, st.cached);
+
+    /* Measure without injected failures, then restore the settings */
+    int old_probability = fail_probability;
+    fail_probability = 0;
+    error_check();
+    double libc = hstats_time(false, n);
+    set_fast_mode(false);
+    double normal = hstats_time(true, n);
+    set_fast_mode(true);
+    double fast = hstats_time(true, n);
+    set_fast_mode(fast_mem != 0);
+    fail_probability = old_probability;
+    harness_stats_reset();
+
+    report(1,
+           "Per malloc/free pair of %d bytes: libc %.1f ns, normal mode "
+           "%.1f ns (%+.1f ns), fast mode %.1f ns (%+.1f ns)",
+           HSTATS_BLOCK_SIZE, libc, normal, normal - libc, fast, fast - libc);
+    return !error_check();
+}
+
+/* Report live and peak bytes of queue allocations */
+static void report_mem()
+{
+    size_t peak, bytes = allocation_bytes(&peak);
+    report(1, "Memory: %lu bytes in %lu blocks, peak %lu bytes since new",
+           bytes, allocation_check(), peak);
+    if (qcnt)
+        report(1, "Per element: %.1f bytes over %lu elements",
+               (double) bytes / qcnt, qcnt);
+}
+
+static bool do_mem(int argc, char *argv[])
+{
+    if (argc != 1) {
+        report(1, "%s takes no arguments", argv[0]);
+        return false;
+    }
+
+    report_mem();
+    return true;
+}
+
+/* Order allocation sites by decreasing number of bytes */
+static int site_cmp(const void *a, const void *b)
+{
+    const alloc_site_t *sa = a, *sb = b;
+    return (sa->bytes < sb->bytes) - (sa->bytes > sb->bytes);
+}
+
+/*
+ * Describe the code at address addr in buf, as symbol+offset when the
+ * symbol is known, and always as object+offset, suitable for addr2line.
+ */
+static void describe_site(void *addr, char *buf, size_t size)
+{
+    Dl_info info;
+    if (!addr) {
+        snprintf(buf, size, "(other sites)");
+        return;
+    }
+    if (!dladdr(addr, &info) || !info.dli_fname) {
+        snprintf(buf, size, "%p", addr);
+        return;
+    }
+    const char *obj = strrchr(info.dli_fname, '/');
+    obj = obj ? obj + 1 : info.dli_fname;
+    size_t off = (size_t) addr - (size_t) info.dli_fbase;
+    if (info.dli_sname)
+        snprintf(buf, size, "%s+0x%lx (%s+0x%lx)", info.dli_sname,
+                 (size_t) addr - (size_t) info.dli_saddr, obj, off);
+    else
+        snprintf(buf, size, "%s+0x%lx", obj, off);
+}
+
+static bool do_memprof(int argc, char *argv[])
+{
+    static alloc_profile_t prof;
+    int top = 10;
+    if (argc > 2) {
+        report(1, "%s takes 0-1 arguments", argv[0]);
+        return false;
+    }
+    if (argc > 1 && (!get_int(argv[1], &top) || top < 0)) {
+        report(1, "Invalid number of sites '%s'", argv[1]);
+        return false;
+    }
+    if (!mem_profile)
+        report(1, "Warning: Profile not being recorded, use option profile 1");
+
+    alloc_profile(&prof);
+    size_t blocks = 0, bytes = 0, freed = 0;
+    double lifetime = 0;
+    for (size_t i = 0; i < prof.nsites; i++) {
+        blocks += prof.sites[i].blocks;
+        bytes += prof.sites[i].bytes;
+        freed += prof.sites[i].freed;
+        lifetime += prof.sites[i].lifetime;
+    }
+    report(1, "Profile: %lu blocks, %lu bytes allocated from %lu sites", blocks,
+           bytes, prof.nsites);
+    report(1, "Live bytes: %lu, peak %lu", prof.live_bytes, prof.peak_bytes);
+    report(1, "Freed blocks: %lu, average lifetime %.3f us", freed,
+           freed ? lifetime / freed * 1e6 : 0.0);
+
+    qsort(prof.sites, prof.nsites, sizeof(alloc_site_t), site_cmp);
+    if (prof.nsites && top)
+        report(1,
+               "%10s %12s %14s  %s (resolve object offsets with addr2line -f "
+               "-e)",
+               "blocks", "bytes", "lifetime (us)", "site");
+    for (size_t i = 0; i < prof.nsites && i < (size_t) top; i++) {
+        alloc_site_t *as = &prof.sites[i];
+        char where[256];
+        describe_site(as->addr, where, sizeof(where));
+        report(1, "%10lu %12lu %14.3f  %s", as->blocks, as->bytes,
+               as->freed ? as->lifetime / as->freed * 1e6 : 0.0, where);
+    }
+
+    for (int c = 0; c < PROFILE_SIZE_CLASSES; c++) {
+        if (prof.size_classes[c])
+            report(1, "Blocks of %lu bytes or less: %lu", (size_t) 1 << c,
+                   prof.size_classes[c]);
+    }
+    return true;
+}
+
+/* Queue commands whose operation can be measured, and which one */
+static const struct {
+    const char *name;
+    int op;
+} measured_cmds[] = {
+    {"new", dut_new},
+    {"free", dut_free},
+    {"ih", dut_insert_head},
+    {"it", dut_insert_tail},
+    {"iho", dut_insert_head_owned},
+    {"ito", dut_insert_tail_owned},
+    {"rh", dut_remove_head},
+    {"rhq", dut_remove_head},
+    {"rt", dut_remove_tail},
+    {"rht", dut_remove_head_take},
+    {"size", dut_size},
+    {"reverse", dut_reverse},
+    {"sort", dut_sort},
+};
+
+/*
+ * Whether arg names the growth model name.  Words cannot hold spaces, so
+ * those of the name are left out, as in O(nlogn).
+ */
+static bool model_matches(const char *arg, const char *name)
+{
+    for (; *name; name++) {
+        if (*name != ' ' && *name != *arg++)
+            return false;
+    }
+    return *arg == '\0';
+}
+
+static bool do_complexity(int argc, char *argv[])
+{
+    if (argc < 2 || argc > 4) {
+        report(1, "%s takes 1-3 arguments", argv[0]);
+        return false;
+    }
+    int op = -1;
+    for (size_t i = 0; i < sizeof(measured_cmds) / sizeof(measured_cmds[0]);
+         i++) {
+        if (strcmp(argv[1], measured_cmds[i].name) == 0)
+            op = measured_cmds[i].op;
+    }
+    if (op < 0) {
+        report(1, "Cannot measure command '%s'", argv[1]);
+        return false;
+    }
+    int max_size = COMPLEXITY_MAX_SIZE;
+    int expected = -1;
+    for (int i = 2; i < argc; i++) {
+        int m = 0;
+        while (m < number_models && !model_matches(argv[i], model_names[m]))
+            m++;
+        if (m < number_models && expected < 0) {
+            expected = m;
+        } else if (i != 2 || !get_int(argv[i], &max_size) ||
+                   max_size < 4 * COMPLEXITY_MIN_SIZE) {
+            report(1,
+                   "Invalid maximum size or model '%s', size takes at "
+                   "least %d",
+                   argv[i], 4 * COMPLEXITY_MIN_SIZE);
+            return false;
+        }
+    }
+
+    static complexity_t c;
+    error_check();
+    if (!estimate_complexity(op, max_size, &c))
+        return false;
+
+    report(1, "%10s %14s", "n", "cycles");
+    for (int i = 0; i < c.points; i++)
+        report(1, "%10lu %14.0f", c.sizes[i], c.cycles[i]);
+    for (int m = 0; m < number_models; m++)
+        report(1, "%-10s error %6.1f%%", model_names[m], c.error[m] * 100);
+    report(1, "Best fit: %s, confidence %.0f%% (next is %s)",
+           model_names[c.best], c.confidence * 100, model_names[c.second]);
+    if (expected >= 0 && c.best != expected) {
+        report(1, "ERROR: Expected %s", model_names[expected]);
+        return false;
+    }
+    return true;
+}
+
 /* Signal handlers */
 static void sigsegvhandler(int sig)
 {
@@ -653,16 +1557,20 @@ static void queue_init()
     signal(SIGALRM, sigalrmhandler);
 }
 
+/* Whether to report memory statistics before freeing the queue at exit */
+static bool mem_at_exit = false;
+
 static bool queue_quit(int argc, char *argv[])
 {
+    if (mem_at_exit)
+        report_mem();
     report(3, "Freeing queue");
-    if (qcnt > big_queue_size)
-        set_cautious_mode(false);
 
-    if (exception_setup(true))
+    if (exception_setup(true)) {
         q_free(q);
+        rq_free(rq);
+    }
     exception_cancel();
-    set_cautious_mode(true);
 
     size_t bcnt = allocation_check();
     if (bcnt > 0) {
@@ -676,11 +1584,17 @@ static bool queue_quit(int argc, char *argv[])
 
 static void usage(char *cmd)
 {
-    printf("Usage: %s [-h] [-f IFILE][-v VLEVEL][-l LFILE]\n", cmd);
+    printf("Usage: %s [-h] [-f IFILE][-v VLEVEL][-l LFILE][-s SEED][-m]\n",
+           cmd);
+    printf("       %s --compile IFILE OFILE\n", cmd);
     printf("\t-h         Print this information\n");
     printf("\t-f IFILE   Read commands from IFILE\n");
     printf("\t-v VLEVEL  Set verbosity level\n");
     printf("\t-l LFILE   Echo results to LFILE\n");
+    printf("\t-s SEED    Seed random generators, to reproduce a run\n");
+    printf("\t-m         Report memory statistics, as mem does, at exit\n");
+    printf("\t--compile  Compile commands of IFILE into binary trace OFILE,\n");
+    printf("\t           which -f IFILE and source run without parsing\n");
     exit(0);
 }
 
@@ -729,10 +1643,20 @@ int main(int argc, char *argv[])
     char lbuf[BUFSIZE];
     char *logfile_name = NULL;
     int level = 4;
+    bool compile = false;
     int c;
 
-    while ((c = getopt(argc, argv, "hv:f:l:")) != -1) {
+    static struct option long_opts[] = {
+        {"compile", no_argument, NULL, 'C'},
+        {NULL, 0, NULL, 0},
+    };
+
+    rand_seed = (int) time(NULL);
+    while ((c = getopt_long(argc, argv, "hv:f:l:s:m", long_opts, NULL)) != -1) {
         switch (c) {
+        case 'C':
+            compile = true;
+            break;
         case 'h':
             usage(argv[0]);
             break;
@@ -749,6 +1673,12 @@ int main(int argc, char *argv[])
             buf[BUFSIZE - 1] = '\0';
             logfile_name = lbuf;
             break;
+        case 's':
+            rand_seed = atoi(optarg);
+            break;
+        case 'm':
+            mem_at_exit = true;
+            break;
         default:
             printf("Unknown option '%c'\n", c);
             usage(argv[0]);
@@ -756,7 +1686,14 @@ int main(int argc, char *argv[])
         }
     }
 
-    srand((unsigned int) (time(NULL)));
+    if (compile) {
+        if (argc - optind != 2)
+            usage(argv[0]);
+        set_verblevel(level);
+        return compile_trace(argv[optind], argv[optind + 1]) ? 0 : 1;
+    }
+
+    seed_changed(rand_seed);
     queue_init();
     init_cmd();
     console_init();
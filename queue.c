@@ -1,11 +1,108 @@
+#include <pthread.h>
+#include <signal.h>
+#include <stdatomic.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 
 #include "harness.h"
 #include "queue.h"
 #include "strnatcmp.h"
 
+/* Number of slots in the first chunk of a queue */
+#define SLAB_MIN_SLOTS 16
+
+/* Chunks stop growing once they hold this many slots */
+#define SLAB_MAX_SLOTS 8192
+
+/*
+ * Allocate a new chunk in front of the chunk list.
+ * Chunk capacity doubles every time, so a queue of n elements only needs
+ * O(log n) calls to malloc until chunks reach SLAB_MAX_SLOTS.
+ * Return false if could not allocate space.
+ */
+static bool slab_grow(queue_t *q)
+{
+    size_t cap = q->slabs ? q->slabs->cap << 1 : SLAB_MIN_SLOTS;
+    if (cap > SLAB_MAX_SLOTS)
+        cap = SLAB_MAX_SLOTS;
+    list_slab_t *slab =
+        malloc(sizeof(list_slab_t) + cap * sizeof(list_slot_t));
+    if (!slab)
+        return false;
+    slab->cap = cap;
+    slab->next = q->slabs;
+    q->slabs = slab;
+    q->slab_used = 0;
+    return true;
+}
+
+/*
+ * Hand out an element slot, preferring recycled ones.
+ * Return NULL if could not allocate space.
+ */
+static list_ele_t *slot_alloc(queue_t *q)
+{
+    list_ele_t *e = q->free_slots;
+    if (e) {
+        q->free_slots = e->next;
+        return e;
+    }
+    if (!q->slabs || q->slab_used == q->slabs->cap) {
+        if (!slab_grow(q))
+            return NULL;
+    }
+    return &q->slabs->slots[q->slab_used++].ele;
+}
+
+/* Whether the string of element e is stored inline in its slot */
+static inline bool value_inline(list_ele_t *e)
+{
+    return e->value == ((list_slot_t *) e)->str;
+}
+
+/*
+ * Give slot of element e back to the arena, releasing its string if the
+ * string was allocated separately.
+ */
+static void slot_release(queue_t *q, list_ele_t *e)
+{
+    if (!value_inline(e)) {
+        free(e->value);
+        q->ext_cnt--;
+    }
+    e->next = q->free_slots;
+    q->free_slots = e;
+}
+
+/*
+ * Allocate an element holding a copy of s.
+ * Short strings are copied into the slot itself, so most insertions cost
+ * a pointer bump rather than two calls to malloc.
+ * Return NULL if could not allocate space.
+ */
+static list_ele_t *ele_new(queue_t *q, const char *s)
+{
+    list_ele_t *e = slot_alloc(q);
+    if (!e)
+        return NULL;
+    size_t len = strlen(s);
+    if (len < INLINE_STR_SIZE) {
+        e->value = ((list_slot_t *) e)->str;
+    } else {
+        e->value = malloc(sizeof(char) * (len + 1));
+        if (!e->value) {
+            e->next = q->free_slots;
+            q->free_slots = e;
+            return NULL;
+        }
+        q->ext_cnt++;
+    }
+    memcpy(e->value, s, len + 1);
+    return e;
+}
+
 /*
  * Create empty queue.
  * Return NULL if could not allocate space.
@@ -17,25 +114,109 @@ queue_t *q_new()
         return NULL;
     q->head = q->tail = NULL;
     q->size = 0;
+    q->slabs = NULL;
+    q->slab_used = 0;
+    q->free_slots = NULL;
+    q->ext_cnt = 0;
+    q->reversed = false;
+    // Reserve the first chunk up front, so that inserting into a fresh queue
+    // costs the same as inserting into a populated one.  Failing here is not
+    // fatal, the chunk will be allocated on first insertion instead.
+    slab_grow(q);
     return q;
 }
 
-/* Free all storage used by queue */
+/*
+ * Free all storage used by queue.
+ * Elements live in chunks, so only strings stored out of their slot have to
+ * be visited one by one.  When there are none, this is O(number of chunks).
+ */
 void q_free(queue_t *q)
 {
     if (!q)
         return;
-    list_ele_t *tmp = q->head, *pre = NULL;
-    while (tmp) {
-        pre = tmp;
-        tmp = tmp->next;
-        if (pre->value)
-            free(pre->value);
+    for (list_ele_t *e = q->head; e && q->ext_cnt; e = e->next) {
+        if (!value_inline(e)) {
+            free(e->value);
+            q->ext_cnt--;
+        }
+    }
+    list_slab_t *slab = q->slabs;
+    while (slab) {
+        list_slab_t *pre = slab;
+        slab = slab->next;
         free(pre);
     }
     free(q);
 }
 
+/*
+ * Link element e in front of the list, ignoring the direction of the queue.
+ */
+static inline void link_front(queue_t *q, list_ele_t *e)
+{
+    e->prev = NULL;
+    e->next = q->head;
+    if (q->head)
+        q->head->prev = e;
+    else
+        q->tail = e;
+    q->head = e;
+    q->size++;
+}
+
+/*
+ * Link element e behind the list, ignoring the direction of the queue.
+ */
+static inline void link_back(queue_t *q, list_ele_t *e)
+{
+    e->next = NULL;
+    e->prev = q->tail;
+    if (q->tail)
+        q->tail->next = e;
+    else
+        q->head = e;
+    q->tail = e;
+    q->size++;
+}
+
+/*
+ * Link element e at the head of the queue if at_head, at its tail otherwise.
+ */
+static inline void link_end(queue_t *q, list_ele_t *e, bool at_head)
+{
+    if (at_head != q->reversed)
+        link_front(q, e);
+    else
+        link_back(q, e);
+}
+
+/*
+ * Unlink the element at the head of the queue if at_head, at its tail
+ * otherwise.  The queue must not be empty.
+ */
+static list_ele_t *unlink_end(queue_t *q, bool at_head)
+{
+    list_ele_t *e;
+    if (at_head != q->reversed) {
+        e = q->head;
+        q->head = e->next;
+        if (q->head)
+            q->head->prev = NULL;
+    } else {
+        e = q->tail;
+        q->tail = e->prev;
+        if (q->tail)
+            q->tail->next = NULL;
+    }
+    // Remove element from queue with size 1,
+    // we have to update both head and tail pointer.
+    if (--(q->size) == 0) {
+        q->head = q->tail = NULL;
+    }
+    return e;
+}
+
 /*
  * Attempt to insert element at head of queue.
  * Return true if successful.
@@ -47,24 +228,10 @@ bool q_insert_head(queue_t *q, char *s)
 {
     if (!q)
         return false;
-    list_ele_t *newh = malloc(sizeof(list_ele_t));
-    /* Don't forget to allocate space for the string and copy it */
-    /* What if either call to malloc returns NULL? */
+    list_ele_t *newh = ele_new(q, s);
     if (!newh)
         return false;
-    newh->value = malloc(sizeof(char) * (strlen(s) + 1));
-    if (!newh->value) {
-        free(newh);
-        return false;
-    }
-    strncpy(newh->value, s, strlen(s));
-    *(newh->value + strlen(s)) = '\0';
-    newh->next = q->head;
-    q->head = newh;
-    // Insert to empty queue, we have to update both head and tail pointer.
-    if (++(q->size) == 1) {
-        q->tail = newh;
-    }
+    link_end(q, newh, true);
     return true;
 }
 
@@ -79,26 +246,101 @@ bool q_insert_tail(queue_t *q, char *s)
 {
     if (!q)
         return false;
-    list_ele_t *newh = malloc(sizeof(list_ele_t));
-    /* Don't forget to allocate space for the string and copy it */
-    /* What if either call to malloc returns NULL? */
+    list_ele_t *newt = ele_new(q, s);
+    if (!newt)
+        return false;
+    link_end(q, newt, false);
+    return true;
+}
+
+/*
+ * Allocate an element taking ownership of string s, without copying it.
+ * Return NULL if could not allocate space, s is then left to the caller.
+ */
+static list_ele_t *ele_new_owned(queue_t *q, char *s)
+{
+    list_ele_t *e = slot_alloc(q);
+    if (!e)
+        return NULL;
+    e->value = s;
+    q->ext_cnt++;
+    return e;
+}
+
+/*
+ * Attempt to insert element at head of queue, taking ownership of s.
+ * Return true if successful.
+ * Return false if q or s is NULL or could not allocate space.
+ * Argument s must have been allocated with malloc.  On success, it is no
+ * longer the caller's, and gets freed when removed from the queue.
+ */
+bool q_insert_head_owned(queue_t *q, char *s)
+{
+    if (!q || !s)
+        return false;
+    list_ele_t *newh = ele_new_owned(q, s);
     if (!newh)
         return false;
-    newh->value = malloc(sizeof(char) * (strlen(s) + 1));
-    if (!newh->value) {
-        free(newh);
+    link_end(q, newh, true);
+    return true;
+}
+
+/*
+ * Attempt to insert element at tail of queue, taking ownership of s.
+ * Same contract as q_insert_head_owned.
+ */
+bool q_insert_tail_owned(queue_t *q, char *s)
+{
+    if (!q || !s)
         return false;
+    list_ele_t *newt = ele_new_owned(q, s);
+    if (!newt)
+        return false;
+    link_end(q, newt, false);
+    return true;
+}
+
+/*
+ * Attempt to remove element from head of queue, handing its string over
+ * to the caller, who has to free it.
+ * Strings stored out of their slot, such as those inserted with
+ * q_insert_head_owned, are handed over as is.  Inline strings have to
+ * leave the slot, so they are copied into a new block.
+ * Return NULL if queue is NULL or empty, or could not allocate space for
+ * the copy, in which case the queue is left unchanged.
+ */
+char *q_remove_head_take(queue_t *q)
+{
+    if (!q || !q->head)
+        return NULL;
+    list_ele_t *tmp = q_first(q);
+    char *s = tmp->value;
+    if (value_inline(tmp)) {
+        s = strdup(tmp->value);
+        if (!s)
+            return NULL;
+    } else
+        q->ext_cnt--;
+    unlink_end(q, true);
+    tmp->next = q->free_slots;
+    q->free_slots = tmp;
+    return s;
+}
+
+/*
+ * Remove element from head of queue if at_head, from its tail otherwise.
+ * Same contract as q_remove_head.
+ */
+static bool remove_end(queue_t *q, char *sp, size_t bufsize, bool at_head)
+{
+    if (!q || !q->head)
+        return false;
+    list_ele_t *tmp = unlink_end(q, at_head);
+    if (sp && bufsize > 0 && tmp->value) {
+        strncpy(sp, tmp->value, bufsize - 1);
+        *(sp + bufsize - 1) = '\0';
     }
-    strncpy(newh->value, s, strlen(s));
-    *(newh->value + strlen(s)) = '\0';
-    newh->next = NULL;
-    if (q->tail)
-        q->tail->next = newh;
-    q->tail = newh;
-    // Insert to empty queue, we have to update both head and tail pointer.
-    if (++(q->size) == 1) {
-        q->head = newh;
-    }
+    slot_release(q, tmp);
     return true;
 }
 
@@ -109,27 +351,148 @@ bool q_insert_tail(queue_t *q, char *s)
  * If sp is non-NULL and an element is removed, copy the removed string to *sp
  * (up to a maximum of bufsize-1 characters, plus a null terminator.)
  * The space used by the list element and the string should be freed.
+ * The element slot is recycled by the arena and released in q_free.
  */
 bool q_remove_head(queue_t *q, char *sp, size_t bufsize)
 {
-    if (!q || !q->head)
-        return false;
-    if (sp && bufsize > 0 && q->head->value) {
-        strncpy(sp, q->head->value, bufsize - 1);
-        *(sp + bufsize - 1) = '\0';
+    return remove_end(q, sp, bufsize, true);
+}
+
+/*
+ * Attempt to remove element from tail of queue.
+ * Same contract as q_remove_head.  The list being doubly-linked, this takes
+ * constant time as well.
+ */
+bool q_remove_tail(queue_t *q, char *sp, size_t bufsize)
+{
+    return remove_end(q, sp, bufsize, false);
+}
+
+/*
+ * Allocate elements for strs[0..n) and link them into a chain, in order.
+ * Stop at the first string that could not be allocated.
+ * Return the number of elements in the chain, whose ends are stored in
+ * *first and *last.
+ */
+static int chain_new(queue_t *q,
+                     char **strs,
+                     int n,
+                     list_ele_t **first,
+                     list_ele_t **last)
+{
+    list_ele_t *head = NULL, **cursor = &head, *e = NULL, *pre = NULL;
+    int cnt = 0;
+    for (; cnt < n; cnt++) {
+        e = ele_new(q, strs[cnt]);
+        if (!e)
+            break;
+        e->prev = pre;
+        *cursor = e;
+        cursor = &e->next;
+        pre = e;
     }
-    list_ele_t *tmp = q->head;
-    q->head = q->head->next;
-    if (tmp->value) {
-        free(tmp->value);
+    *cursor = NULL;
+    *first = head;
+    *last = pre;
+    return cnt;
+}
+
+/*
+ * Insert elements holding copies of strs[0..n) at head of queue if at_head,
+ * at its tail otherwise, as if they were inserted one by one in turn.
+ * All elements are linked into a chain first, then spliced into the list
+ * with a single update of one of its ends.
+ * Return the number of elements inserted.
+ */
+static int insert_bulk(queue_t *q, char **strs, int n, bool at_head)
+{
+    if (!q || n <= 0)
+        return 0;
+    list_ele_t *first, *last;
+    int cnt = chain_new(q, strs, n, &first, &last);
+    if (!cnt)
+        return 0;
+    if (at_head != q->reversed) {
+        // Inserting one by one in front leaves the chain reversed.
+        for (list_ele_t *e = first; e; e = e->prev) {
+            list_ele_t *nex = e->next;
+            e->next = e->prev;
+            e->prev = nex;
+        }
+        first->next = q->head;
+        if (q->head)
+            q->head->prev = first;
+        else
+            q->tail = first;
+        q->head = last;
+    } else {
+        last->next = NULL;
+        first->prev = q->tail;
+        if (q->tail)
+            q->tail->next = first;
+        else
+            q->head = first;
+        q->tail = last;
     }
-    free(tmp);
-    // Remove element from queue with size 1,
-    // we have to update both head and tail pointer.
-    if (--(q->size) == 0) {
+    q->size += cnt;
+    return cnt;
+}
+
+/*
+ * Insert elements holding copies of strs[0..n) at head of queue, as if
+ * q_insert_head was called for each of them in turn.
+ * Return the number of elements inserted.  Fewer than n means that space
+ * could not be allocated for the next string.
+ */
+int q_insert_head_bulk(queue_t *q, char **strs, int n)
+{
+    return insert_bulk(q, strs, n, true);
+}
+
+/*
+ * Insert elements holding copies of strs[0..n) at tail of queue, in order.
+ * Return the number of elements inserted.  Fewer than n means that space
+ * could not be allocated for the next string.
+ */
+int q_insert_tail_bulk(queue_t *q, char **strs, int n)
+{
+    return insert_bulk(q, strs, n, false);
+}
+
+/*
+ * Remove up to n elements from head of queue.
+ * The elements are detached with a single update of the head.
+ * If bufs is non-NULL, the string of the i-th removed element is copied to
+ * bufs[i] like q_remove_head does, unless bufs[i] is NULL.
+ * Return the number of elements removed, 0 if q is NULL or empty.
+ */
+int q_remove_head_bulk(queue_t *q, char **bufs, int n, size_t bufsize)
+{
+    if (!q || n <= 0)
+        return 0;
+    if (n > q->size)
+        n = q->size;
+    list_ele_t *e = q_first(q);
+    for (int i = 0; i < n; i++) {
+        list_ele_t *nex = q_next(q, e);
+        if (bufs && bufs[i] && bufsize > 0) {
+            strncpy(bufs[i], e->value, bufsize - 1);
+            bufs[i][bufsize - 1] = '\0';
+        }
+        slot_release(q, e);
+        e = nex;
+    }
+    q->size -= n;
+    if (!q->size)
         q->head = q->tail = NULL;
+    else if (q->reversed) {
+        e->next = NULL;
+        q->tail = e;
+    } else {
+        e->prev = NULL;
+        q->head = e;
     }
-    return true;
+    return n;
 }
 
 /*
@@ -146,27 +509,47 @@ int q_size(queue_t *q)
 /*
  * Reverse elements in queue
  * No effect if q is NULL or empty
- * This function should not allocate or free any list elements
- * (e.g., by calling q_insert_head, q_insert_tail, or q_remove_head).
- * It should rearrange the existing ones.
+ * The links are left alone, only the direction in which the queue walks
+ * them gets flipped.  The list is put back in order by the next sort.
  */
 void q_reverse(queue_t *q)
 {
-    if (!q || q->size <= 1)
+    if (!q)
         return;
-    list_ele_t *pre = NULL, *cur = q->head, *nex = q->head->next;
-    while (nex) {
-        cur->next = pre;
-        pre = cur;
-        cur = nex;
-        nex = cur->next;
+    q->reversed = !q->reversed;
+}
+
+/*
+ * Make the links of the list follow the order of the queue, swapping next
+ * and prev of every element if the queue is reversed.
+ */
+static void straighten(queue_t *q)
+{
+    if (!q->reversed)
+        return;
+    for (list_ele_t *e = q->head; e; e = e->prev) {
+        list_ele_t *nex = e->next;
+        e->next = e->prev;
+        e->prev = nex;
     }
-    cur->next = pre;
-    cur = q->head;
+    list_ele_t *tmp = q->head;
     q->head = q->tail;
-    q->tail = cur;
+    q->tail = tmp;
+    q->reversed = false;
 }
 
+/*
+ * Restore the prev pointers of the list, after sorting moved elements
+ * around through their next pointers only.
+ */
+static void relink_prev(queue_t *q)
+{
+    list_ele_t *pre = NULL;
+    for (list_ele_t *e = q->head; e; e = e->next) {
+        e->prev = pre;
+        pre = e;
+    }
+}
 
 /*
  * Sort elements of queue in ascending order
@@ -177,69 +560,362 @@ void q_sort(queue_t *q)
 {
     if (!q || q->size <= 1)
         return;
-    q->tail = q->head = merge_sort(q->head);
-    // After merge sort, the pointer q->tail would no longer point
-    // to the tail of queue anymore.
-    while (q->tail->next) {
-        q->tail = q->tail->next;
-    }
+    straighten(q);
+    q->head = merge_sort(q->head, &q->tail);
+    relink_prev(q);
+}
+
+/* Cached sort key of element e */
+static inline uint64_t ele_key(const list_ele_t *e)
+{
+    return ((const list_slot_t *) e)->key;
 }
 
 /*
- * Merge sort for lined list. This function will use divide & conquer
- * strategy to solve the sorting proble.
- * Return value: a linked list.
+ * Order of two elements, following the natural order of their strings.
+ * Most comparisons are resolved by the cached keys, only elements sharing
+ * the same key need a full strnatcasecmp.
  */
-list_ele_t *merge_sort(list_ele_t *head)
+static inline int ele_cmp(const list_ele_t *a, const list_ele_t *b)
 {
-    if (!head || !head->next)
-        return head;
-    list_ele_t *fast = head->next;
-    list_ele_t *slow = head;
-    // Use the concept of "Tortoise and Hare" help us find the cutting point.
-    while (fast && fast->next) {
-        slow = slow->next;
-        fast = fast->next->next;
-    }
-    // Redirect the pointer to the right partition and split the given list.
-    fast = slow->next;
-    slow->next = NULL;
-    // Recursive call to sort the sub-lists.
-    head = merge_sort(head);
-    fast = merge_sort(fast);
-
-    return merge(head, fast);
+    uint64_t ka = ele_key(a), kb = ele_key(b);
+    if (ka != kb)
+        return ka < kb ? -1 : 1;
+    return strnatcasecmp(a->value, b->value);
 }
 
 /*
- * Merge 2 linked list into 1 linked list in ascending order.
+ * Merge 2 sorted linked lists into 1 linked list in ascending order.
+ * t1 and t2 are the last elements of p1 and p2, the last element of the
+ * merged list is stored in *tail.  Equal elements keep their order, with
+ * those from p1 first.
  */
-list_ele_t *merge(list_ele_t *p1, list_ele_t *p2)
+static list_ele_t *merge(list_ele_t *p1,
+                         list_ele_t *t1,
+                         list_ele_t *p2,
+                         list_ele_t *t2,
+                         list_ele_t **tail)
 {
     list_ele_t *head = NULL;
     list_ele_t **cursor = &head;
-    // Merge 2 list according to their Lexicographical order.
+    // Merge 2 list according to their natural order.
     while (p1 && p2) {
-        // if (str_cmp(p1->value, p2->value) >= 0) {
-        if (strnatcasecmp(p1->value, p2->value) >= 0) {
+        if (ele_cmp(p1, p2) > 0) {
             *cursor = p2;
             p2 = p2->next;
-            cursor = &((*cursor)->next);
         } else {
             *cursor = p1;
             p1 = p1->next;
-            cursor = &((*cursor)->next);
         }
+        cursor = &((*cursor)->next);
     }
     // Append the last remaining list to the end of merged list.
     if (p1) {
         *cursor = p1;
+        *tail = t1;
     } else {
         *cursor = p2;
+        *tail = t2;
+    }
+    return head;
+}
+
+/*
+ * Detach the natural run at the front of *list.
+ * A run is either non-decreasing, or strictly decreasing in which case it
+ * gets reversed on the fly (strictness keeps the sort stable).
+ * *list is advanced past the run, and its last element is stored in *tail.
+ */
+static list_ele_t *next_run(list_ele_t **list, list_ele_t **tail)
+{
+    list_ele_t *head = *list, *cur = head, *nex = head->next;
+    if (nex && ele_cmp(cur, nex) > 0) {
+        list_ele_t *run = head;
+        *tail = head;
+        do {
+            cur = nex;
+            nex = cur->next;
+            cur->next = run;
+            run = cur;
+        } while (nex && ele_cmp(cur, nex) > 0);
+        head->next = NULL;
+        *list = nex;
+        return run;
     }
+    while (nex && ele_cmp(cur, nex) <= 0) {
+        cur = nex;
+        nex = cur->next;
+    }
+    cur->next = NULL;
+    *tail = cur;
+    *list = nex;
     return head;
 }
 
+/* Compute the sort key of every element of list head */
+static void fill_keys(list_ele_t *head)
+{
+    for (list_ele_t *e = head; e; e = e->next)
+        ((list_slot_t *) e)->key = strnatcasekey(e->value);
+}
+
+/* A run has at most 2^31 elements, so does the number of runs */
+#define SORT_MAX_LEVEL 32
+
+/*
+ * Merge natural runs of list head, assuming sort keys are already filled.
+ * Natural runs are split off the front of the list and pushed onto a
+ * pending stack, where level i holds the merge of 2^i runs, like the
+ * digits of a binary counter.  Pushing a run carries merges upward, so
+ * every element is touched O(log n) times, without recursion and without
+ * measuring the length of any sublist.
+ */
+static list_ele_t *sort_runs(list_ele_t *head, list_ele_t **tail)
+{
+    list_ele_t *pending[SORT_MAX_LEVEL] = {NULL};
+    list_ele_t *pending_tail[SORT_MAX_LEVEL];
+    list_ele_t *run = NULL, *run_tail = NULL;
+    int max_level = 0;
+
+    while (head) {
+        run = next_run(&head, &run_tail);
+        int lv = 0;
+        // Older runs go first when merging, which keeps the sort stable.
+        for (; pending[lv]; lv++) {
+            run = merge(pending[lv], pending_tail[lv], run, run_tail,
+                        &run_tail);
+            pending[lv] = NULL;
+        }
+        pending[lv] = run;
+        pending_tail[lv] = run_tail;
+        if (lv >= max_level)
+            max_level = lv + 1;
+    }
+
+    // Collapse the stack.  Lower levels hold the more recent elements.
+    run = NULL;
+    for (int lv = 0; lv < max_level; lv++) {
+        if (!pending[lv])
+            continue;
+        if (run)
+            run = merge(pending[lv], pending_tail[lv], run, run_tail,
+                        &run_tail);
+        else {
+            run = pending[lv];
+            run_tail = pending_tail[lv];
+        }
+    }
+    *tail = run_tail;
+    return run;
+}
+
+/*
+ * Bottom-up merge sort for linked list.
+ * Sort keys of all elements are computed once up front, then natural runs
+ * are merged.
+ * Return value: a linked list, whose last element is stored in *tail.
+ */
+list_ele_t *merge_sort(list_ele_t *head, list_ele_t **tail)
+{
+    fill_keys(head);
+    return sort_runs(head, tail);
+}
+
+/* Buckets with fewer elements than this are merge sorted instead */
+#define RADIX_CUTOFF 32
+
+/* Number of key bytes, i.e. maximum depth of radix_sort */
+#define RADIX_DEPTH ((int) sizeof(uint64_t))
+
+/*
+ * MSD radix sort for linked list, on the bytes of the sort keys.
+ * List head has n elements, whose keys agree on their first depth bytes.
+ * Elements are distributed among 256 bucket lists by the next key byte, and
+ * each bucket is sorted recursively before the buckets get concatenated.
+ * Small buckets, and buckets whose keys are fully consumed, are left to
+ * sort_runs, which resolves the remaining ties with strnatcasecmp.
+ * Return value: a linked list, whose last element is stored in *tail.
+ */
+static list_ele_t *radix_sort(list_ele_t *head,
+                              int n,
+                              int depth,
+                              list_ele_t **tail)
+{
+    if (n < RADIX_CUTOFF || depth == RADIX_DEPTH)
+        return sort_runs(head, tail);
+
+    list_ele_t *bucket[256] = {NULL};
+    list_ele_t *bucket_tail[256];
+    int bucket_cnt[256] = {0};
+    int shift = 8 * (RADIX_DEPTH - 1 - depth);
+
+    // Distribution keeps the relative order, so the sort stays stable.
+    for (list_ele_t *e = head; e; e = e->next) {
+        int b = (ele_key(e) >> shift) & 0xff;
+        if (bucket[b])
+            bucket_tail[b]->next = e;
+        else
+            bucket[b] = e;
+        bucket_tail[b] = e;
+        bucket_cnt[b]++;
+    }
+
+    head = NULL;
+    list_ele_t **cursor = &head;
+    for (int b = 0; b < 256; b++) {
+        if (!bucket[b])
+            continue;
+        bucket_tail[b]->next = NULL;
+        *cursor = radix_sort(bucket[b], bucket_cnt[b], depth + 1, tail);
+        cursor = &((*tail)->next);
+    }
+    return head;
+}
+
+/*
+ * Sort elements of queue in ascending order, using MSD radix sort.
+ * Same ordering and restrictions as q_sort, no list element is allocated.
+ */
+void q_sort_radix(queue_t *q)
+{
+    if (!q || q->size <= 1)
+        return;
+    straighten(q);
+    fill_keys(q->head);
+    q->head = radix_sort(q->head, q->size, 0, &q->tail);
+    relink_prev(q);
+}
+
+/* Queues smaller than this are not worth sorting in parallel */
+#define PSORT_MIN_SIZE (1 << 14)
+
+/* Maximum number of threads used by q_sort_parallel */
+#define PSORT_MAX_THREADS 64
+
+/*
+ * The list is cut into this many segments per thread, so that threads done
+ * with cheap segments pick up the remaining ones instead of idling.
+ */
+#define PSORT_SEGS_PER_THREAD 4
+
+#define PSORT_MAX_SEGS (PSORT_MAX_THREADS * PSORT_SEGS_PER_THREAD)
+
+/* Sorted segment of the list being sorted */
+typedef struct {
+    list_ele_t *head, *tail;
+} psort_seg_t;
+
+/*
+ * Tasks shared by the sorting threads.
+ * With stride 0, task i sorts segment i.  Otherwise task i merges segment
+ * 2 * i * stride with the segment stride further.
+ */
+typedef struct {
+    psort_seg_t *segs;
+    int stride;
+    int ntasks;
+    atomic_int next; /* Next task to be picked up */
+} psort_job_t;
+
+/* Keep picking up tasks of job until none is left */
+static void *psort_worker(void *arg)
+{
+    psort_job_t *job = arg;
+    int i;
+    while ((i = atomic_fetch_add(&job->next, 1)) < job->ntasks) {
+        if (!job->stride) {
+            psort_seg_t *seg = &job->segs[i];
+            fill_keys(seg->head);
+            seg->head = sort_runs(seg->head, &seg->tail);
+        } else {
+            psort_seg_t *a = &job->segs[2 * i * job->stride];
+            psort_seg_t *b = a + job->stride;
+            a->head = merge(a->head, a->tail, b->head, b->tail, &a->tail);
+        }
+    }
+    return NULL;
+}
+
+/*
+ * Run all tasks of job on up to nthreads threads, the calling thread being
+ * one of them.  Signals are blocked in the helper threads, so that the
+ * alarm of the test harness is delivered to the calling thread.
+ * Failing to create a thread only means less parallelism.
+ */
+static void psort_run(psort_job_t *job, int nthreads)
+{
+    pthread_t tid[PSORT_MAX_THREADS];
+    sigset_t all, old;
+    int spawned = 0;
+
+    atomic_store(&job->next, 0);
+    if (nthreads > job->ntasks)
+        nthreads = job->ntasks;
+
+    sigfillset(&all);
+    pthread_sigmask(SIG_SETMASK, &all, &old);
+    for (; spawned < nthreads - 1; spawned++) {
+        if (pthread_create(&tid[spawned], NULL, psort_worker, job))
+            break;
+    }
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+
+    psort_worker(job);
+    for (int i = 0; i < spawned; i++)
+        pthread_join(tid[i], NULL);
+}
+
+/*
+ * Sort elements of queue in ascending order, using up to nthreads threads.
+ * The list is cut into segments of equal length, which the threads sort
+ * concurrently with the natural merge sort.  Sorted segments are then
+ * merged pairwise, each round of merges running in parallel as well.
+ * Same ordering and restrictions as q_sort, no list element is allocated.
+ */
+void q_sort_parallel(queue_t *q, int nthreads)
+{
+    if (!q || q->size <= 1)
+        return;
+    if (nthreads <= 0)
+        nthreads = (int) sysconf(_SC_NPROCESSORS_ONLN);
+    if (nthreads > PSORT_MAX_THREADS)
+        nthreads = PSORT_MAX_THREADS;
+    if (nthreads <= 1 || q->size < PSORT_MIN_SIZE) {
+        q_sort(q);
+        return;
+    }
+
+    straighten(q);
+    psort_seg_t segs[PSORT_MAX_SEGS];
+    psort_job_t job = {.segs = segs, .stride = 0};
+    int nsegs = nthreads * PSORT_SEGS_PER_THREAD;
+
+    // Cut the list.  Segment lengths differ by at most one element.
+    int len = q->size / nsegs, extra = q->size % nsegs;
+    list_ele_t *e = q->head;
+    for (int i = 0; i < nsegs; i++) {
+        segs[i].head = e;
+        for (int k = len + (i < extra) - 1; k > 0; k--)
+            e = e->next;
+        segs[i].tail = e;
+        e = e->next;
+        segs[i].tail->next = NULL;
+    }
+
+    job.ntasks = nsegs;
+    psort_run(&job, nthreads);
+
+    // Merging neighbours only keeps the sort stable.
+    for (int stride = 1; stride < nsegs; stride <<= 1) {
+        job.stride = stride;
+        job.ntasks = (nsegs + stride - 1) / (2 * stride);
+        psort_run(&job, nthreads);
+    }
+    q->head = segs[0].head;
+    q->tail = segs[0].tail;
+    relink_prev(q);
+}
+
 /*
  * Compare two character strings according to their Lexicographical order.
  * Return value is greater than, equal to, or less than zero, accordingly
@@ -5,29 +5,90 @@
  * This program implements a queue supporting both FIFO and LIFO
  * operations.
  *
- * It uses a singly-linked list to represent the set of queue elements
+ * It uses a doubly-linked list to represent the set of queue elements,
+ * so that both ends can be removed from in constant time.
  */
 
 #include <stdbool.h>
 #include <stddef.h>
+#include <stdint.h>
 
 /* Data structure declarations */
 
-/* Linked list element (You shouldn't need to change this) */
+/* Linked list element */
 typedef struct ELE {
     /* Pointer to array holding string.
      * This array needs to be explicitly allocated and freed
      */
     char *value;
-    struct ELE *next;
+    struct ELE *next, *prev;
 } list_ele_t;
 
+/* Strings shorter than this are stored inline, right behind their element */
+#define INLINE_STR_SIZE 24
+
+/*
+ * Storage handed out by the slab arena: one element plus its inline string.
+ * The sort key caches the natural order of the leading characters of the
+ * string, it is only valid while q_sort is running.
+ */
+typedef struct SLOT {
+    list_ele_t ele;
+    uint64_t key;
+    char str[INLINE_STR_SIZE];
+} list_slot_t;
+
+/*
+ * Contiguous chunk of slots.
+ * Chunks are chained together so that q_free can release them in bulk.
+ */
+typedef struct SLAB {
+    struct SLAB *next;
+    size_t cap; /* Number of slots in this chunk */
+    list_slot_t slots[];
+} list_slab_t;
+
 /* Queue structure */
 typedef struct {
     list_ele_t *head, *tail; /* Linked list of elements */
     int size;                /* Memorizing the size of queue */
+    list_slab_t *slabs;      /* Chunks backing the elements, newest first */
+    size_t slab_used;        /* Slots already handed out from newest chunk */
+    list_ele_t *free_slots;  /* Recycled slots, chained through next */
+    int ext_cnt;             /* Elements whose string lives out of its slot */
+    bool reversed;           /* Queue order runs from tail to head */
 } queue_t;
 
+/*
+ * The list is linked from head to tail through next, and back through prev.
+ * q_reverse only flips reversed, so walking the queue in order has to go
+ * through the following helpers.
+ */
+
+/* First element of queue q, NULL if empty */
+static inline list_ele_t *q_first(const queue_t *q)
+{
+    return q->reversed ? q->tail : q->head;
+}
+
+/* Last element of queue q, NULL if empty */
+static inline list_ele_t *q_last(const queue_t *q)
+{
+    return q->reversed ? q->head : q->tail;
+}
+
+/* Element following e in queue q, NULL if e is the last one */
+static inline list_ele_t *q_next(const queue_t *q, const list_ele_t *e)
+{
+    return q->reversed ? e->prev : e->next;
+}
+
+/* Element preceding e in queue q, NULL if e is the first one */
+static inline list_ele_t *q_prev(const queue_t *q, const list_ele_t *e)
+{
+    return q->reversed ? e->next : e->prev;
+}
+
 /* Operations on queue */
 
 /*
@@ -60,6 +121,31 @@ bool q_insert_head(queue_t *q, char *s);
  */
 bool q_insert_tail(queue_t *q, char *s);
 
+/*
+ * Attempt to insert element at head of queue, taking ownership of s.
+ * Return true if successful.
+ * Return false if q or s is NULL or could not allocate space.
+ * Argument s must have been allocated with malloc.  It is stored without
+ * being copied, and freed when removed from the queue.  If the insertion
+ * fails, s still belongs to the caller.
+ */
+bool q_insert_head_owned(queue_t *q, char *s);
+
+/*
+ * Attempt to insert element at tail of queue, taking ownership of s.
+ * Same contract as q_insert_head_owned.
+ */
+bool q_insert_tail_owned(queue_t *q, char *s);
+
+/*
+ * Attempt to remove element from head of queue, handing its string over.
+ * Return the string, which the caller has to free.
+ * Return NULL if queue is NULL or empty, or could not allocate space.
+ * Strings inserted with q_insert_{head,tail}_owned are returned without
+ * being copied.
+ */
+char *q_remove_head_take(queue_t *q);
+
 /*
  * Attempt to remove element from head of queue.
  * Return true if successful.
@@ -70,6 +156,38 @@ bool q_insert_tail(queue_t *q, char *s);
  */
 bool q_remove_head(queue_t *q, char *sp, size_t bufsize);
 
+/*
+ * Attempt to remove element from tail of queue, in constant time.
+ * Same contract as q_remove_head.
+ */
+bool q_remove_tail(queue_t *q, char *sp, size_t bufsize);
+
+/*
+ * Insert elements holding copies of strs[0..n) at head of queue.
+ * Same result as calling q_insert_head for each string in turn, but the
+ * new elements are linked together first and spliced in at once.
+ * Return the number of elements inserted: fewer than n means that space
+ * could not be allocated for the next string, 0 if q is NULL.
+ */
+int q_insert_head_bulk(queue_t *q, char **strs, int n);
+
+/*
+ * Insert elements holding copies of strs[0..n) at tail of queue.
+ * Same result as calling q_insert_tail for each string in turn, but the
+ * new elements are linked together first and spliced in at once.
+ * Return the number of elements inserted: fewer than n means that space
+ * could not be allocated for the next string, 0 if q is NULL.
+ */
+int q_insert_tail_bulk(queue_t *q, char **strs, int n);
+
+/*
+ * Remove up to n elements from head of queue.
+ * If bufs is non-NULL, the string of the i-th removed element is copied to
+ * bufs[i] (unless NULL) as q_remove_head does, using bufsize.
+ * Return the number of elements removed, 0 if q is NULL or empty.
+ */
+int q_remove_head_bulk(queue_t *q, char **bufs, int n, size_t bufsize);
+
 /*
  * Return number of elements in queue.
  * Return 0 if q is NULL or empty
@@ -77,11 +195,11 @@ bool q_remove_head(queue_t *q, char *sp, size_t bufsize);
 int q_size(queue_t *q);
 
 /*
- * Reverse elements in queue
+ * Reverse elements in queue, in constant time
  * No effect if q is NULL or empty
  * This function should not allocate or free any list elements
  * (e.g., by calling q_insert_head, q_insert_tail, or q_remove_head).
- * It should rearrange the existing ones.
+ * Only the direction in which the list is walked gets flipped.
  */
 void q_reverse(queue_t *q);
 
@@ -93,15 +211,28 @@ void q_reverse(queue_t *q);
 void q_sort(queue_t *q);
 
 /*
- * Merge sort for lined list. This function will use divide & conquer
- * strategy to solve the sorting proble.
+ * Sort elements of queue in ascending order, with MSD radix sort on the
+ * leading characters of the strings.
+ * Same ordering as q_sort, which is faster for large queues of short
+ * strings.  No effect if q is NULL or has less than two elements.
+ */
+void q_sort_radix(queue_t *q);
+
+/*
+ * Sort elements of queue in ascending order, using up to nthreads threads.
+ * nthreads <= 0 means one thread per online processor.
+ * Same ordering as q_sort.  No effect if q is NULL or has less than two
+ * elements, small queues are sorted by q_sort.
  */
-list_ele_t *merge_sort(list_ele_t *head);
+void q_sort_parallel(queue_t *q, int nthreads);
 
 /*
- * Merge 2 linked list into 1 linked list in ascending order.
+ * Bottom-up merge sort for linked list, taking advantage of natural runs.
+ * Sort the NULL-terminated list starting at head in ascending order.
+ * Return the new head, and store the last element in *tail.
+ * Only next pointers are updated, prev pointers are left stale.
  */
-list_ele_t *merge(list_ele_t *list1, list_ele_t *list2);
+list_ele_t *merge_sort(list_ele_t *head, list_ele_t **tail);
 
 /*
  * Compare two character strings according to their Lexicographical order.
@@ -2,10 +2,14 @@
 #include <assert.h>
 #include <fcntl.h>
 #include <stdint.h>
+#include <string.h>
 #include <unistd.h>
 
+/* Bytes read from /dev/urandom at once */
+#define RANDOM_BUF_SIZE 65536
+
 /* shameless stolen from ebacs */
-void randombytes(uint8_t *x, size_t how_much)
+static void urandom_read(uint8_t *x, size_t how_much)
 {
     ssize_t i;
     static int fd = -1;
@@ -38,9 +42,81 @@ void randombytes(uint8_t *x, size_t how_much)
     }
 }
 
+/*
+ * Random bytes are served from a buffer refilled RANDOM_BUF_SIZE bytes at
+ * a time, so that small requests do not cost a system call each.
+ * Requests larger than the buffer bypass it.  Not thread safe.
+ */
+void randombytes(uint8_t *x, size_t how_much)
+{
+    static uint8_t buf[RANDOM_BUF_SIZE];
+    static size_t avail = 0;
+
+    if (how_much >= RANDOM_BUF_SIZE) {
+        urandom_read(x, how_much);
+        return;
+    }
+    while (how_much > 0) {
+        if (!avail) {
+            urandom_read(buf, RANDOM_BUF_SIZE);
+            avail = RANDOM_BUF_SIZE;
+        }
+        size_t n = how_much < avail ? how_much : avail;
+        memcpy(x, buf + RANDOM_BUF_SIZE - avail, n);
+        avail -= n;
+        x += n;
+        how_much -= n;
+    }
+}
+
+/* Bits are taken one at a time from a cached random word */
 uint8_t randombit(void)
 {
-    uint8_t ret = 0;
-    randombytes(&ret, 1);
-    return (ret & 1);
+    static uint64_t bits;
+    static int nbits = 0;
+
+    if (!nbits) {
+        randombytes((uint8_t *) &bits, sizeof(bits));
+        nbits = 64;
+    }
+    uint8_t ret = bits & 1;
+    bits >>= 1;
+    nbits--;
+    return ret;
+}
+
+/* Step of the splitmix64 generator, used to expand seeds */
+static uint64_t splitmix64(uint64_t *x)
+{
+    uint64_t z = (*x += 0x9e3779b97f4a7c15ULL);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+}
+
+void prng_seed(prng_t *g, uint64_t seed, uint64_t stream)
+{
+    uint64_t x = seed ^ splitmix64(&stream);
+    for (int i = 0; i < 4; i++)
+        g->s[i] = splitmix64(&x);
+}
+
+static inline uint64_t rotl(uint64_t x, int k)
+{
+    return (x << k) | (x >> (64 - k));
+}
+
+/* xoshiro256** by David Blackman and Sebastiano Vigna */
+uint64_t prng_next(prng_t *g)
+{
+    uint64_t *s = g->s;
+    uint64_t result = rotl(s[1] * 5, 7) * 9;
+    uint64_t t = s[1] << 17;
+    s[2] ^= s[0];
+    s[3] ^= s[1];
+    s[1] ^= s[2];
+    s[0] ^= s[3];
+    s[2] ^= t;
+    s[3] = rotl(s[3], 45);
+    return result;
 }
@@ -6,4 +6,21 @@
 void randombytes(uint8_t *x, size_t xlen);
 uint8_t randombit(void);
 
+/*
+ * State of a xoshiro256** pseudo random number generator.
+ * Fast and reproducible, but not suitable where unpredictability matters.
+ */
+typedef struct {
+    uint64_t s[4];
+} prng_t;
+
+/*
+ * Seed generator g.  Generators seeded with the same seed but different
+ * streams produce unrelated sequences.
+ */
+void prng_seed(prng_t *g, uint64_t seed, uint64_t stream);
+
+/* Next 64 random bits of generator g */
+uint64_t prng_next(prng_t *g);
+
 #endif
@@ -0,0 +1,209 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "harness.h"
+#include "rqueue.h"
+
+/* String stored in slot */
+static inline char *slot_value(ring_slot_t *slot)
+{
+    return slot->ext ? slot->ext : slot->str;
+}
+
+/*
+ * Copy s into slot.
+ * Return false if s does not fit inline and could not allocate space.
+ */
+static bool slot_fill(ring_slot_t *slot, const char *s)
+{
+    size_t len = strlen(s);
+    if (len < INLINE_STR_SIZE) {
+        slot->ext = NULL;
+        memcpy(slot->str, s, len + 1);
+        return true;
+    }
+    slot->ext = malloc(sizeof(char) * (len + 1));
+    if (!slot->ext)
+        return false;
+    memcpy(slot->ext, s, len + 1);
+    return true;
+}
+
+/*
+ * Create empty queue holding up to capacity elements.
+ * Return NULL if could not allocate space, or capacity cannot be rounded up
+ * to a power of two.
+ */
+rqueue_t *rq_new(size_t capacity)
+{
+    if (capacity > SIZE_MAX / 2)
+        return NULL;
+    size_t cap = 1;
+    while (cap < capacity)
+        cap <<= 1;
+    rqueue_t *q = malloc(sizeof(rqueue_t));
+    if (!q)
+        return NULL;
+    q->slots = malloc(sizeof(ring_slot_t) * cap);
+    if (!q->slots) {
+        free(q);
+        return NULL;
+    }
+    q->mask = cap - 1;
+    atomic_init(&q->head, 0);
+    atomic_init(&q->tail, 0);
+    q->tail_cache = q->head_cache = 0;
+    return q;
+}
+
+/* Free all storage used by queue */
+void rq_free(rqueue_t *q)
+{
+    if (!q)
+        return;
+    size_t tail = atomic_load(&q->tail);
+    for (size_t i = atomic_load(&q->head); i != tail; i++) {
+        if (q->slots[i & q->mask].ext)
+            free(q->slots[i & q->mask].ext);
+    }
+    free(q->slots);
+    free(q);
+}
+
+/*
+ * Attempt to insert element at tail of queue.
+ * Return true if successful.
+ * Return false if q is NULL, is full or could not allocate space.
+ */
+bool rq_insert_tail(rqueue_t *q, char *s)
+{
+    if (!q)
+        return false;
+    size_t t = atomic_load_explicit(&q->tail, memory_order_relaxed);
+    if (t - q->head_cache > q->mask) {
+        // Looks full, see how far the consumer got since last time.
+        q->head_cache = atomic_load_explicit(&q->head, memory_order_acquire);
+        if (t - q->head_cache > q->mask)
+            return false;
+    }
+    if (!slot_fill(&q->slots[t & q->mask], s))
+        return false;
+    // Release pairs with the acquire in rq_remove_head, publishing the slot.
+    atomic_store_explicit(&q->tail, t + 1, memory_order_release);
+    return true;
+}
+
+/*
+ * Attempt to remove element from head of queue.
+ * Return true if successful.
+ * Return false if queue is NULL or empty.
+ */
+bool rq_remove_head(rqueue_t *q, char *sp, size_t bufsize)
+{
+    if (!q)
+        return false;
+    size_t h = atomic_load_explicit(&q->head, memory_order_relaxed);
+    if (h == q->tail_cache) {
+        // Looks empty, see how far the producer got since last time.
+        q->tail_cache = atomic_load_explicit(&q->tail, memory_order_acquire);
+        if (h == q->tail_cache)
+            return false;
+    }
+    ring_slot_t *slot = &q->slots[h & q->mask];
+    if (sp && bufsize > 0) {
+        strncpy(sp, slot_value(slot), bufsize - 1);
+        *(sp + bufsize - 1) = '\0';
+    }
+    if (slot->ext)
+        free(slot->ext);
+    // Release hands the slot back to the producer once we are done with it.
+    atomic_store_explicit(&q->head, h + 1, memory_order_release);
+    return true;
+}
+
+/*
+ * Return number of elements in queue.
+ * Return 0 if q is NULL or empty
+ */
+int rq_size(rqueue_t *q)
+{
+    if (!q)
+        return 0;
+    size_t h = atomic_load_explicit(&q->head, memory_order_acquire);
+    size_t t = atomic_load_explicit(&q->tail, memory_order_acquire);
+    return (int) (t - h);
+}
+
+/*
+ * Attempt to insert element at head of queue.
+ * Return true if successful.
+ * Return false if q is NULL, is full or could not allocate space.
+ */
+bool rq_insert_head(rqueue_t *q, char *s)
+{
+    if (!q)
+        return false;
+    size_t h = atomic_load(&q->head), t = atomic_load(&q->tail);
+    if (t - h > q->mask)
+        return false;
+    if (!slot_fill(&q->slots[(h - 1) & q->mask], s))
+        return false;
+    atomic_store(&q->head, h - 1);
+    // Both cached copies must never be ahead of the real indices.
+    q->head_cache = q->tail_cache = h - 1;
+    return true;
+}
+
+/*
+ * Attempt to remove element from tail of queue.
+ * Return true if successful.
+ * Return false if queue is NULL or empty.
+ */
+bool rq_remove_tail(rqueue_t *q, char *sp, size_t bufsize)
+{
+    if (!q)
+        return false;
+    size_t h = atomic_load(&q->head), t = atomic_load(&q->tail);
+    if (h == t)
+        return false;
+    ring_slot_t *slot = &q->slots[(t - 1) & q->mask];
+    if (sp && bufsize > 0) {
+        strncpy(sp, slot_value(slot), bufsize - 1);
+        *(sp + bufsize - 1) = '\0';
+    }
+    if (slot->ext)
+        free(slot->ext);
+    atomic_store(&q->tail, t - 1);
+    q->head_cache = q->tail_cache = h;
+    return true;
+}
+
+/*
+ * Reverse elements in queue
+ * No effect if q is NULL or empty
+ */
+void rq_reverse(rqueue_t *q)
+{
+    if (!q)
+        return;
+    size_t h = atomic_load(&q->head), t = atomic_load(&q->tail);
+    for (; t - h > 1; h++, t--) {
+        ring_slot_t tmp = q->slots[h & q->mask];
+        q->slots[h & q->mask] = q->slots[(t - 1) & q->mask];
+        q->slots[(t - 1) & q->mask] = tmp;
+    }
+}
+
+/*
+ * Return string of the i-th element from head of queue.
+ * Return NULL if q is NULL or has no such element.
+ */
+const char *rq_value(rqueue_t *q, int i)
+{
+    if (!q || i < 0 || i >= rq_size(q))
+        return NULL;
+    size_t h = atomic_load(&q->head);
+    return slot_value(&q->slots[(h + i) & q->mask]);
+}
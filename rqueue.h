@@ -0,0 +1,123 @@
+#ifndef LAB0_RQUEUE_H
+#define LAB0_RQUEUE_H
+
+/*
+ * This program implements a bounded queue on top of a ring buffer.
+ *
+ * One producer thread may insert at the tail while one consumer thread
+ * removes from the head, without any lock.  Short strings are stored in
+ * the ring itself, so neither side calls malloc for them.
+ */
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "queue.h"
+
+/* Data structure declarations */
+
+/* Size of a cache line, used to keep both ends of the queue apart */
+#ifndef CACHE_LINE_SIZE
+#define CACHE_LINE_SIZE 64
+#endif
+
+/* Ring buffer slot, holding strings shorter than INLINE_STR_SIZE inline */
+typedef struct {
+    char *ext; /* Heap copy of strings too long for str, or NULL */
+    char str[INLINE_STR_SIZE];
+} ring_slot_t;
+
+/*
+ * Ring buffer queue structure.
+ * Indices run freely and are reduced modulo the capacity on access.
+ * Each side publishes its own index with a release store on every
+ * operation, but keeps a private copy of the index owned by the other side
+ * and only reloads it when the ring looks full or empty, so it reads the
+ * other side's cache line once per batch of operations rather than every
+ * time.
+ */
+typedef struct {
+    ring_slot_t *slots;
+    size_t mask; /* Capacity minus one, capacity is a power of two */
+    char pad0[CACHE_LINE_SIZE];
+    atomic_size_t head; /* Next slot to remove, written by consumer */
+    size_t tail_cache;  /* Consumer's copy of tail */
+    char pad1[CACHE_LINE_SIZE];
+    atomic_size_t tail; /* Next slot to fill, written by producer */
+    size_t head_cache;  /* Producer's copy of head */
+    char pad2[CACHE_LINE_SIZE];
+} rqueue_t;
+
+/* Operations on ring buffer queue */
+
+/*
+ * Create empty queue holding up to capacity elements.
+ * Capacity is rounded up to a power of two, 1 being the smallest.
+ * Return NULL if could not allocate space.
+ */
+rqueue_t *rq_new(size_t capacity);
+
+/*
+ * Free ALL storage used by queue.
+ * No effect if q is NULL
+ */
+void rq_free(rqueue_t *q);
+
+/*
+ * Attempt to insert element at tail of queue.
+ * Only call from the producer thread.
+ * Return true if successful.
+ * Return false if q is NULL, is full or could not allocate space.
+ * Argument s points to the string to be stored.
+ */
+bool rq_insert_tail(rqueue_t *q, char *s);
+
+/*
+ * Attempt to remove element from head of queue.
+ * Only call from the consumer thread.
+ * Return true if successful.
+ * Return false if queue is NULL or empty.
+ * If sp is non-NULL and an element is removed, copy the removed string to *sp
+ * (up to a maximum of bufsize-1 characters, plus a null terminator.)
+ */
+bool rq_remove_head(rqueue_t *q, char *sp, size_t bufsize);
+
+/*
+ * Return number of elements in queue.
+ * Return 0 if q is NULL or empty
+ */
+int rq_size(rqueue_t *q);
+
+/*
+ * The following operations are not safe while a producer or consumer
+ * thread is running.
+ */
+
+/*
+ * Attempt to insert element at head of queue.
+ * Return true if successful.
+ * Return false if q is NULL, is full or could not allocate space.
+ */
+bool rq_insert_head(rqueue_t *q, char *s);
+
+/*
+ * Attempt to remove element from tail of queue.
+ * Return true if successful.
+ * Return false if queue is NULL or empty.
+ */
+bool rq_remove_tail(rqueue_t *q, char *sp, size_t bufsize);
+
+/*
+ * Reverse elements in queue
+ * No effect if q is NULL or empty
+ */
+void rq_reverse(rqueue_t *q);
+
+/*
+ * Return string of the i-th element from head of queue.
+ * Return NULL if q is NULL or has no such element.
+ */
+const char *rq_value(rqueue_t *q, int i);
+
+#endif /* LAB0_RQUEUE_H */
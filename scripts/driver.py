@@ -4,6 +4,9 @@ from __future__ import print_function
 import subprocess
 import sys
 import getopt
+import os
+import shutil
+import tempfile
 
 
 
@@ -42,7 +45,25 @@ class Tracer:
         20: "trace-20-test-debvers",
         21: "trace-21-test-fractions",
         22: "trace-22-test-versions",
-        23: "trace-23-test-words"
+        23: "trace-23-test-words",
+        24: "trace-24-radix",
+        25: "trace-25-parallel",
+        26: "trace-26-concurrent",
+        27: "trace-27-ring",
+        28: "trace-28-bulk",
+        29: "trace-29-owned",
+        30: "trace-30-deque",
+        31: "trace-31-complexity-deque",
+        32: "trace-32-cautious-free",
+        33: "trace-33-fastmem",
+        34: "trace-34-memprof",
+        35: "trace-35-seed",
+        36: "trace-36-complexity-budget",
+        37: "trace-37-complexity-ops",
+        38: "trace-38-complexity-estimate",
+        39: "trace-39-replay",
+        40: "trace-40-leak",
+        41: "trace-41-malloc-slab"
     }
 
     traceProbs = {
@@ -69,11 +90,42 @@ class Tracer:
         20: "Trace-20",
         21: "Trace-21",
         22: "Trace-22",
-        23: "Trace-23"
+        23: "Trace-23",
+        24: "Trace-24",
+        25: "Trace-25",
+        26: "Trace-26",
+        27: "Trace-27",
+        28: "Trace-28",
+        29: "Trace-29",
+        30: "Trace-30",
+        31: "Trace-31",
+        32: "Trace-32",
+        33: "Trace-33",
+        34: "Trace-34",
+        35: "Trace-35",
+        36: "Trace-36",
+        37: "Trace-37",
+        38: "Trace-38",
+        39: "Trace-39",
+        40: "Trace-40",
+        41: "Trace-41"
     }
 
     maxScores = [0, 6, 6, 6, 6, 5, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 5,
-                6, 6, 6, 6, 6, 6]
+                6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 5,
+                6, 6, 6, 6, 5, 5, 5, 6, 5, 6]
+
+    # Perf traces, run with the memory statistics reported at exit
+    memTraces = [13, 14, 15, 16]
+
+    # Trace compiled and run by the compiled step, and the step's points
+    compiledTrace = 6
+    compiledScore = 5
+
+    # Traces run again on the ring buffer backend, which cannot sort, and
+    # the step's points
+    ringTraces = [1, 2, 3, 9, 10, 11, 12, 13, 14]
+    ringScore = 5
 
     RED = '\033[91m'
     GREEN = '\033[92m'
@@ -104,7 +156,9 @@ class Tracer:
         fname = "%s/%s.cmd" % (self.traceDirectory, self.traceDict[tid])
         vname = "%d" % self.verbLevel
         clist = self.command + ["-v", vname, "-f", fname]
-        
+        if tid in self.memTraces:
+            clist.append("-m")
+
         try:
             retcode = subprocess.call(clist)
         except Exception as e:
@@ -112,6 +166,72 @@ class Tracer:
             return False
         return retcode == 0
 
+    def capture(self, args):
+        clist = self.command + args
+        try:
+            p = subprocess.Popen(clist, stdout=subprocess.PIPE)
+            out = p.communicate()[0]
+        except Exception as e:
+            self.printInColor("Call of '%s' failed: %s" % (" ".join(clist), e), self.RED)
+            return None, ""
+        return p.returncode, out.decode(errors="replace")
+
+    # Compile a trace, check that it runs like its source, and that a
+    # truncated copy of it is rejected
+    def runCompiled(self, tid):
+        src = "%s/%s.cmd" % (self.traceDirectory, self.traceDict[tid])
+        tmpdir = tempfile.mkdtemp()
+        try:
+            qtb = os.path.join(tmpdir, "trace.qtb")
+            retcode, out = self.capture(["--compile", src, qtb])
+            if retcode != 0:
+                print(out, end='')
+                return False
+            runArgs = ["-v", "3", "-s", "1", "-f"]
+            textcode, textout = self.capture(runArgs + [src])
+            qtbcode, qtbout = self.capture(runArgs + [qtb])
+            if textcode != 0 or qtbcode != textcode or qtbout != textout:
+                print("Compiled trace output differs from '%s'" % src)
+                return False
+            bad = os.path.join(tmpdir, "truncated.qtb")
+            with open(qtb, "rb") as f:
+                data = f.read()
+            with open(bad, "wb") as f:
+                f.write(data[:-1])
+            retcode, out = self.capture(runArgs + [bad])
+            if retcode in (None, 0) or "Corrupt compiled trace" not in out:
+                print("Truncated compiled trace was not rejected")
+                return False
+            return True
+        finally:
+            shutil.rmtree(tmpdir)
+
+    # Run each of the ring traces with the ring buffer backend selected first
+    def runRing(self):
+        tmpdir = tempfile.mkdtemp()
+        try:
+            for tid in self.ringTraces:
+                src = "%s/%s.cmd" % (self.traceDirectory, self.traceDict[tid])
+                fname = os.path.join(tmpdir, os.path.basename(src))
+                with open(src) as f:
+                    body = f.read()
+                with open(fname, "w") as f:
+                    f.write("option backend 1\n" + body)
+                if self.verbLevel > 0:
+                    print("+++ TESTING trace %s on ring buffer:" % self.traceDict[tid])
+                clist = self.command + ["-v", "%d" % self.verbLevel, "-f", fname]
+                try:
+                    retcode = subprocess.call(clist)
+                except Exception as e:
+                    self.printInColor("Call of '%s' failed: %s" % (" ".join(clist), e), self.RED)
+                    return False
+                if retcode != 0:
+                    print("Trace '%s' failed on the ring buffer backend" % src)
+                    return False
+            return True
+        finally:
+            shutil.rmtree(tmpdir)
+
     def run(self, tid=0):
         scoreDict = {k: 0 for k in self.traceDict.keys()}
         print("---\tTrace\t\tPoints")
@@ -142,6 +262,23 @@ class Tracer:
             score += tval
             maxscore += maxval
             scoreDict[t] = tval
+        if tid == 0:
+            if self.verbLevel > 0:
+                print("+++ TESTING compiled %s:" % self.traceDict[self.compiledTrace])
+            ok = self.runCompiled(self.compiledTrace)
+            maxval = self.compiledScore
+            tval = maxval if ok else 0
+            color = self.GREEN if tval == maxval else self.RED
+            self.printInColor("---\tcompiled-trace\t%d/%d" % (tval, maxval), color)
+            score += tval
+            maxscore += maxval
+            ok = self.runRing()
+            maxval = self.ringScore
+            tval = maxval if ok else 0
+            color = self.GREEN if tval == maxval else self.RED
+            self.printInColor("---\tring-backend\t%d/%d" % (tval, maxval), color)
+            score += tval
+            maxscore += maxval
         if score < maxscore:
             self.printInColor("---\tTOTAL\t\t%d/%d" % (score, maxscore), self.RED)
         else:
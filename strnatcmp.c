@@ -171,3 +171,36 @@ int strnatcasecmp(nat_char const *a, nat_char const *b)
 {
     return strnatcmp0(a, b, 1);
 }
+
+
+/* Build a key out of the first 8 characters that strnatcmp0 would look at,
+ * one byte per character.  Whitespace is skipped, as it is when comparing.
+ * Letters are folded to upper case, and every digit is mapped to '0' since
+ * digit runs can only be ordered by looking at the whole run; the key ends
+ * after the first digit or at the end of the string, and is padded with
+ * zeros.  Bytes are offset by 0x80 so that they order like a signed
+ * nat_char, which puts the terminating NUL above negative characters. */
+uint64_t strnatcasekey(nat_char const *a)
+{
+    uint64_t key = 0;
+    int n = 0;
+
+    while (n < 8) {
+        nat_char ca = *a++;
+        int last;
+
+        if (nat_isspace(ca))
+            continue;
+
+        last = !ca || nat_isdigit(ca);
+        ca = nat_isdigit(ca) ? '0' : nat_toupper(ca);
+
+        key = (key << 8) | (uint8_t)((unsigned char) ca ^ 0x80);
+        n++;
+
+        if (last)
+            break;
+    }
+
+    return key << (8 * (8 - n));
+}
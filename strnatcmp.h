@@ -27,5 +27,13 @@
  * functions in strnatcmp.c */
 typedef char nat_char;
 
+#include <stdint.h>
+
 int strnatcmp(nat_char const *a, nat_char const *b);
 int strnatcasecmp(nat_char const *a, nat_char const *b);
+
+/* Order-preserving key of the leading characters of a string.
+ *
+ * If strnatcasekey(a) < strnatcasekey(b), then strnatcasecmp(a, b) < 0.
+ * Equal keys tell nothing, and the strings must be compared in full. */
+uint64_t strnatcasekey(nat_char const *a);
@@ -0,0 +1,34 @@
+# Test of radix sort against natural order and large random queues
+option fail 0
+option malloc 0
+option sortmode 1
+new
+ih pic100
+ih pic02a
+ih x2-y08
+ih 1.010
+ih Pic4
+ih 1.10
+ih pic5 
+ih pic02000
+ih 2000-1-10
+ih 1999-12-25
+ih jane
+it fred
+it pic5
+sort
+rh 1.010
+rh 1.10
+rh 1999-12-25
+rh 2000-1-10
+rh fred
+rh jane
+free
+new
+ih RAND 200000
+sort
+reverse
+sort
+it zzzzzzzzz 1000
+sort
+free
@@ -0,0 +1,22 @@
+# Test of parallel sort with random, descending and mostly sorted orders
+option fail 0
+option malloc 0
+option sortmode 2
+option threads 4
+new
+ih RAND 100000
+sort
+reverse
+sort
+it aaaa 1000
+ih zzzzzzzzz 1000
+sort
+rh aaaa
+free
+new
+ih 1.10 20000
+ih 1.010 20000
+ih 1.2 20000
+sort
+rh 1.010
+free
@@ -0,0 +1,9 @@
+# Test of concurrent queue shared by several threads
+option fail 0
+option malloc 0
+cstress 4 10000
+new
+ih dolphin
+cstress 8 1000
+rh dolphin
+free
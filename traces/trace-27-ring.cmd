@@ -0,0 +1,28 @@
+# Test of ring buffer backend: insert, remove, reverse and capacity limit
+option fail 10
+option malloc 0
+option backend 1
+option ringcap 8
+new
+ih dolphin
+ih bear
+it gerbil
+it aardvark_bear_dolphin_gerbil_jaguar
+reverse
+rh aardvark_bear_dolphin_gerbil_jaguar
+it meerkat 6
+size
+rh gerbil
+rh dolphin
+rh bear
+rh meerkat
+free
+option ringcap 1048576
+new
+it dolphin 1000000
+ih gerbil 1000
+size 1000
+reverse
+rh dolphin
+free
+option backend 0
@@ -0,0 +1,25 @@
+# Test of bulk insert_head, insert_tail and remove_head
+option fail 10
+option malloc 0
+new
+ih gerbil 3
+it meerkat 2
+ih RAND 2000
+it bear 2000
+rhn 2001
+rh gerbil
+rh gerbil
+rh meerkat
+rh meerkat
+rhn 1999
+rh bear
+rhn 1
+size
+free
+new
+ih dolphin 1000000
+it jaguar 1000000
+rhn 1999999
+rh jaguar
+size
+free
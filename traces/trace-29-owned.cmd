@@ -0,0 +1,27 @@
+# Test of handing string ownership over to and back from the queue
+option fail 10
+option malloc 0
+new
+iho gerbil 2
+ito a_rather_long_name_for_a_meerkat 2
+ih bear
+it dolphin
+rht bear
+rht gerbil
+rh gerbil
+rht a_rather_long_name_for_a_meerkat
+rht a_rather_long_name_for_a_meerkat
+rht dolphin
+iho RAND 10
+ito jaguar 10
+reverse
+sort
+rht
+free
+option fail 30
+new
+option malloc 25
+iho squirrel 10
+ito vulture 10
+rht
+free
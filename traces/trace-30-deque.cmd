@@ -0,0 +1,68 @@
+# Test of remove_tail and lazy reverse, mixed with the other operations
+option fail 10
+option malloc 0
+new
+ih dolphin
+ih bear
+it gerbil
+it a_rather_long_name_for_a_meerkat
+rt a_rather_long_name_for_a_meerkat
+reverse
+rh gerbil
+rt bear
+ih vulture
+it squirrel
+rt squirrel
+ih RAND 100
+it jaguar 100
+reverse
+rhn 100
+rh dolphin
+rh vulture
+rhn 100
+size
+free
+new
+ih d
+ih c
+ih b
+ih a
+reverse
+ih e 3
+it x 2
+iho f
+rht f
+rh e
+rh e
+rh e
+rh d
+reverse
+rh x
+rh x
+rh a
+rt c
+rt b
+size
+it z
+ih y
+reverse
+sort
+rh y
+rh z
+ih bear 50
+it dolphin 50
+reverse
+sort
+rt dolphin
+rh bear
+free
+option backend 1
+new
+it gerbil
+it bear
+rt bear
+reverse
+rt gerbil
+size
+free
+option backend 0
@@ -0,0 +1,5 @@
+# Test if q_remove_tail and q_reverse are constant time complexity
+option simulation 1
+rt
+reverse
+option simulation 0
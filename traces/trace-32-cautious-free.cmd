@@ -0,0 +1,9 @@
+# Test performance of freeing a large queue of separately allocated strings
+option fail 0
+option malloc 0
+new
+ih a_rather_long_name_for_a_meerkat_or_a_gerbil 1000000
+it and_an_even_longer_name_for_a_large_dolphin 1000000
+rhn 1000
+mem
+free
@@ -0,0 +1,27 @@
+# Test of queue operations with the harness in fast mode
+option fail 30
+option malloc 0
+option fastmem 1
+new
+ih a_rather_long_name_for_a_meerkat_or_a_gerbil 1000000
+it dolphin 1000000
+rhn 1000
+reverse
+sort
+mem
+free
+new
+ih gerbil 3
+it a_rather_long_name_for_a_bear 3
+option fastmem 0
+rh gerbil
+rt a_rather_long_name_for_a_bear
+it a_rather_long_name_for_a_dolphin
+option fastmem 1
+rh gerbil
+rt a_rather_long_name_for_a_dolphin
+option malloc 25
+it a_rather_long_name_for_a_vulture 20
+option malloc 0
+free
+option fastmem 0
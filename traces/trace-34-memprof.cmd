@@ -0,0 +1,26 @@
+# Test of the allocation profile, in both harness modes
+option fail 10
+option malloc 0
+option profile 1
+new
+ih gerbil 1000
+it a_rather_long_name_for_a_meerkat_or_a_gerbil 1000
+iho squirrel 10
+rht squirrel
+rhn 500
+memprof 3
+option fastmem 1
+rhn 500
+ito a_rather_long_name_for_a_dolphin 100
+free
+memprof
+option profile 0
+option fastmem 0
+new
+ih bear 10
+memprof 0
+option profile 1
+rhn 10
+free
+memprof 1
+option profile 0
@@ -0,0 +1,18 @@
+# Test of reproducible RAND strings with a fixed seed
+option fail 10
+option malloc 0
+option seed 7
+new
+ih RAND 3
+it RAND 2
+rh edjfluhvi
+rh fplqybwno
+rh vjhyiqo
+rh rxfocg
+rh fwkuhywu
+option seed 7
+it RAND 3
+rh vjhyiqo
+rh fplqybwno
+rh edjfluhvi
+free
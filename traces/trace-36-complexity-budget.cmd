@@ -0,0 +1,9 @@
+# Test if constant time checks decide within a time budget, without stopping early
+option simulation 1
+option sequential 0
+option budget 2000
+size
+reverse
+option budget 0
+option sequential 1
+option simulation 0
@@ -0,0 +1,9 @@
+# Test if q_new, q_insert_head, q_remove_head and their owned variants are constant time complexity
+option simulation 1
+new
+ih
+rh
+iho
+ito
+rht
+option simulation 0
@@ -0,0 +1,6 @@
+# Test estimating how the cost of queue operations grows with the queue length
+complexity size 16000 O(1)
+complexity it 16000 O(1)
+complexity reverse 16000 O(1)
+complexity sort 64000
+complexity free 64000 O(n)
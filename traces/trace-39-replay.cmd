@@ -0,0 +1,3 @@
+# Test replaying a timed log of queue operations, paced and as fast as possible
+replay traces/trace-39-replay.log
+replay traces/trace-39-replay.log fast
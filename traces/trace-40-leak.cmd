@@ -0,0 +1,2 @@
+# Test if a walk over the first few elements is caught as not constant time
+leak
@@ -0,0 +1,21 @@
+# Test of malloc failure on insertions needing a new chunk or a long string
+option fail 30
+option malloc 0
+new
+ih gerbil 16
+option malloc 100
+ih dolphin
+it dolphin
+ih dolphin 4
+size
+rh gerbil
+rh gerbil
+it a_string_too_long_to_be_stored_inline
+ih a_string_too_long_to_be_stored_inline 2
+it jaguar 2
+size
+option malloc 0
+it a_string_too_long_to_be_stored_inline
+rh gerbil
+it jaguar
+size